@@ -0,0 +1,121 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "capture.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <string>
+
+// Capture files start with an eight byte signature followed by one record per
+// read from the socket: a 64-bit timestamp (microseconds since the epoch), a
+// 32-bit length, and the received bytes. All integers are little-endian.
+
+static const char captureSignature[8] = { 'I', 'R', 'C', 'C', 'A', 'P', '0', '1' };
+
+bool Capture::open(const std::string &fileName)
+{
+	close();
+	file.open(fileName.c_str(), std::ios::out | std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	file.write(captureSignature, sizeof(captureSignature));
+	return true;
+}
+
+void Capture::close()
+{
+	if (file.is_open())
+	{
+		file.close();
+	}
+}
+
+bool Capture::isOpen()
+{
+	return file.is_open();
+}
+
+void Capture::write(const char *data, std::size_t length)
+{
+	boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+	boost::uint64_t timestamp = static_cast<boost::uint64_t>(elapsed.total_microseconds());
+	char header[12];
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		header[i] = static_cast<char>((timestamp >> (i * 8)) & 0xFF);
+	}
+	for (std::size_t i = 0; i < 4; ++i)
+	{
+		header[i + 8] = static_cast<char>((static_cast<boost::uint32_t>(length) >> (i * 8)) & 0xFF);
+	}
+	file.write(header, sizeof(header));
+	// The network thread holds core->mutex here, so records are left to the
+	// stream's buffer and reach the disk when it fills or the capture stops
+	file.write(data, length);
+}
+
+bool CaptureReader::open(const std::string &fileName)
+{
+	file.open(fileName.c_str(), std::ios::in | std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	char signature[8];
+	file.read(signature, sizeof(signature));
+	if (file.gcount() != sizeof(signature) || !std::equal(signature, signature + sizeof(signature), captureSignature))
+	{
+		file.close();
+		return false;
+	}
+	return true;
+}
+
+bool CaptureReader::read(boost::uint64_t &timestamp, std::string &data)
+{
+	unsigned char header[12];
+	file.read(reinterpret_cast<char*>(header), sizeof(header));
+	if (file.gcount() != sizeof(header))
+	{
+		return false;
+	}
+	timestamp = 0;
+	for (std::size_t i = 0; i < 8; ++i)
+	{
+		timestamp |= static_cast<boost::uint64_t>(header[i]) << (i * 8);
+	}
+	boost::uint32_t length = 0;
+	for (std::size_t i = 0; i < 4; ++i)
+	{
+		length |= static_cast<boost::uint32_t>(header[i + 8]) << (i * 8);
+	}
+	data.resize(length);
+	if (length)
+	{
+		file.read(&data[0], length);
+		if (static_cast<boost::uint32_t>(file.gcount()) != length)
+		{
+			return false;
+		}
+	}
+	return true;
+}
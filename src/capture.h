@@ -0,0 +1,45 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef CAPTURE_H
+#define CAPTURE_H
+
+#include <boost/cstdint.hpp>
+
+#include <fstream>
+#include <string>
+
+class Capture
+{
+public:
+	bool open(const std::string &fileName);
+	void close();
+	bool isOpen();
+	void write(const char *data, std::size_t length);
+private:
+	std::ofstream file;
+};
+
+class CaptureReader
+{
+public:
+	bool open(const std::string &fileName);
+	bool read(boost::uint64_t &timestamp, std::string &data);
+private:
+	std::ifstream file;
+};
+
+#endif
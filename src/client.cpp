@@ -16,25 +16,89 @@
 
 #include "client.h"
 
+#include "command.h"
 #include "core.h"
 #include "main.h"
+#include "text.h"
+#include "trace.h"
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/algorithm/string.hpp>
 #include <boost/enable_shared_from_this.hpp>
-#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
 #include <limits>
 #include <list>
 #include <map>
-#include <queue>
 #include <set>
 #include <sstream>
 #include <string>
 #include <vector>
 
+namespace
+{
+	std::string joinNames(const std::set<std::string> &names)
+	{
+		// Keep the list within what a script can reasonably receive; the
+		// count passed alongside it is always complete
+		std::string list;
+		for (std::set<std::string>::const_iterator n = names.begin(); n != names.end(); ++n)
+		{
+			if (list.length() + n->length() + 1 > MAX_BUFFER)
+			{
+				break;
+			}
+			if (!list.empty())
+			{
+				list.push_back(' ');
+			}
+			list.append(*n);
+		}
+		return list;
+	}
+
+	bool matchesMask(const char *mask, const char *name)
+	{
+		// Case-insensitive glob match where * matches any run of characters and
+		// ? matches exactly one
+		const char *starMask = NULL, *starName = NULL;
+		while (*name)
+		{
+			if (*mask == '*')
+			{
+				starMask = ++mask;
+				starName = name;
+			}
+			else if (*mask == '?' || std::tolower(static_cast<unsigned char>(*mask)) == std::tolower(static_cast<unsigned char>(*name)))
+			{
+				++mask;
+				++name;
+			}
+			else if (starMask)
+			{
+				mask = starMask;
+				name = ++starName;
+			}
+			else
+			{
+				return false;
+			}
+		}
+		while (*mask == '*')
+		{
+			++mask;
+		}
+		return !*mask;
+	}
+}
+
 Client::Client(boost::asio::io_service &io_service) :
 	clientSocket(io_service),
 	context(io_service, boost::asio::ssl::context::sslv23_client),
@@ -42,8 +106,15 @@ Client::Client(boost::asio::io_service &io_service) :
 	secureClientSocket(io_service, context),
 	connectTimer(io_service),
 	connectTimeoutTimer(io_service),
+	keepAliveTimer(io_service),
+	netSplitTimer(io_service),
+	outboxTimer(io_service),
+	queryTimer(io_service),
 	receiveTimeoutTimer(io_service),
-	resolveTimer(io_service)
+	relayTimer(io_service),
+	rejoinTimer(io_service),
+	resolveTimer(io_service),
+	scheduleTimer(io_service)
 {
 	const char *commands[] =
 	{
@@ -57,21 +128,37 @@ Client::Client(boost::asio::io_service &io_service) :
 		"MODE",
 		"PRIVMSG",
 		"NOTICE",
-		"PING"
+		"PING",
+		"CAP",
+		"ACCOUNT",
+		"AWAY"
 	};
 	for (std::size_t i = 0; i < sizeof(commands) / sizeof(const char*); ++i)
 	{
 		serverCommands.insert(std::make_pair(commands[i], i));
 	}
+	charset = Text::UTF8;
 	connectAttempts = 5;
 	connectDelay = 20;
 	connectTimeout = 10;
+	formatting = Text::KeepFormatting;
+	lastScheduleID = 0;
+	network.reset(new Network);
+	outboxPenalty = boost::posix_time::microsec_clock::universal_time();
+	outboxSize = 0;
+	outboxTTL = 300;
+	relaySize = 0;
+	relayWindow = 0;
+	closing = false;
 	connected = false;
+	flushPending = false;
 	context.set_verify_mode(boost::asio::ssl::context::verify_none);
 	currentConnectAttempts = 1;
 	receiveTimeout = std::numeric_limits<int>::max();
 	respawn = true;
 	quitting = false;
+	queryReply = false;
+	readPaused = false;
 	timedOut = false;
 	writeInProgress = false;
 }
@@ -89,11 +176,7 @@ void Client::handleConnect(const boost::system::error_code &error, boost::asio::
 		}
 		else
 		{
-			if (!serverPassword.empty())
-			{
-				sendAsync(boost::str(boost::format("PASS %1%\r\n") % serverPassword));
-			}
-			sendAsync(boost::str(boost::format("USER %1% 0 * :%2%\r\nNICK %3%\r\n") % username % realname % nickname));
+			sendRegistration();
 			startRead();
 			connectTimeoutTimer.cancel();
 		}
@@ -108,7 +191,7 @@ void Client::handleConnect(const boost::system::error_code &error, boost::asio::
 			message.array.push_back(botID);
 			message.buffer.push_back("Connection attempt timed out");
 			message.buffer.push_back(iterator->endpoint().address().to_string());
-			core->messages.push(message);
+			core->pushMessage(message);
 			startConnectTimer(iterator);
 		}
 		else
@@ -119,7 +202,7 @@ void Client::handleConnect(const boost::system::error_code &error, boost::asio::
 			message.array.push_back(botID);
 			message.buffer.push_back(error.message());
 			message.buffer.push_back(iterator->endpoint().address().to_string());
-			core->messages.push(message);
+			core->pushMessage(message);
 			stopAsync();
 			startConnectTimer(iterator);
 		}
@@ -131,11 +214,7 @@ void Client::handleHandshake(const boost::system::error_code &error)
 	boost::mutex::scoped_lock lock(core->mutex);
 	if (!error)
 	{
-		if (!serverPassword.empty())
-		{
-			sendAsync(boost::str(boost::format("PASS %1%\r\n") % serverPassword));
-		}
-		sendAsync(boost::str(boost::format("USER %1% 0 * :%2%\r\nNICK %3%\r\n") % username % realname % nickname));
+		sendRegistration();
 		startRead();
 		connectTimeoutTimer.cancel();
 	}
@@ -147,7 +226,7 @@ void Client::handleHandshake(const boost::system::error_code &error)
 		message.array.push_back(botID);
 		message.buffer.push_back(error.message());
 		message.buffer.push_back(connectedAddress);
-		core->messages.push(message);
+		core->pushMessage(message);
 		stopAsync();
 		startAsync();
 	}
@@ -155,38 +234,26 @@ void Client::handleHandshake(const boost::system::error_code &error)
 
 void Client::handleRead(const boost::system::error_code &error, std::size_t transferredBytes)
 {
+	TRACE_SPAN("Client::handleRead");
+	TRACE_BEGIN(lockSpan, "core->mutex wait");
 	boost::mutex::scoped_lock lock(core->mutex);
+	TRACE_END(lockSpan);
 	if (!error)
 	{
-		std::string messageBuffer = receivedData;
-		messageBuffer.resize(transferredBytes);
-		boost::algorithm::erase_all(messageBuffer, "\r");
-		boost::algorithm::erase_last(messageBuffer, "\n");
-		std::vector<std::string> splitBuffer;
-		boost::algorithm::split(splitBuffer, messageBuffer, boost::algorithm::is_any_of("\n"));
-		for (std::vector<std::string>::iterator i = splitBuffer.begin(); i != splitBuffer.end(); ++i)
+		if (capture.isOpen())
 		{
-			if (!i->empty())
-			{
-				Data::Message message;
-				message.array.push_back(Data::OnReceiveRaw);
-				message.array.push_back(botID);
-				if (i->length() > MAX_BUFFER / 8)
-				{
-					std::string tempBuffer = *i;
-					tempBuffer.resize(MAX_BUFFER / 8);
-					message.buffer.push_back(tempBuffer);
-				}
-				else
-				{
-					message.buffer.push_back(*i);
-				}
-				core->messages.push(message);
-				parseBuffer(*i);
-			}
+			capture.write(receivedData, transferredBytes);
+		}
+		processData(receivedData, transferredBytes);
+		if (core->isQueueFull())
+		{
+			pauseRead();
+		}
+		else
+		{
+			startReceiveTimeoutTimer();
+			startRead();
 		}
-		startReceiveTimeoutTimer();
-		startRead();
 	}
 	else
 	{
@@ -206,7 +273,7 @@ void Client::handleRead(const boost::system::error_code &error, std::size_t tran
 		message.array.push_back(botID);
 		message.buffer.push_back(reason);
 		message.buffer.push_back(connectedAddress);
-		core->messages.push(message);
+		core->pushMessage(message);
 		if (!quitting)
 		{
 			stopAsync();
@@ -234,26 +301,53 @@ void Client::handleResolve(const boost::system::error_code &error, boost::asio::
 		message.array.push_back(botID);
 		message.buffer.push_back(error.message());
 		message.buffer.push_back(remoteAddress);
-		core->messages.push(message);
+		core->pushMessage(message);
 		startResolveTimer();
 	}
 }
 
+void Client::sendRegistration()
+{
+	Command(*this, "CAP").parameter("LS").parameter("302").send(false);
+	if (!serverPassword.empty())
+	{
+		Command(*this, "PASS").parameter(serverPassword).send(false);
+	}
+	Command(*this, "USER").parameter(username).parameter("0").parameter("*").trailing(realname).send(false);
+	Command(*this, "NICK").parameter(nickname).send();
+}
+
 void Client::handleWrite(const boost::system::error_code &error)
 {
+	TRACE_SPAN("Client::handleWrite");
+	TRACE_BEGIN(lockSpan, "core->mutex wait");
 	boost::mutex::scoped_lock lock(core->mutex);
+	TRACE_END(lockSpan);
 	writeInProgress = false;
 	if (!error)
 	{
-		if (!pendingMessages.empty())
-		{
-			sendAsync(pendingMessages.front());
-			pendingMessages.pop();
-		}
+		startWrite();
 	}
 	else
 	{
-		pendingMessages = std::queue<std::string>();
+		outboundBuffer.clear();
+	}
+	if (closing && !writeInProgress)
+	{
+		// stopAsync left the socket open for the QUIT, which has now gone out
+		boost::system::error_code ignored;
+		closing = false;
+		outboundBuffer.clear();
+		if (ssl)
+		{
+			secureClientSocket.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+			secureClientSocket.lowest_layer().close(ignored);
+		}
+		else
+		{
+			clientSocket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+			clientSocket.close(ignored);
+		}
 	}
 }
 
@@ -269,7 +363,7 @@ void Client::handleConnectTimer(const boost::system::error_code &error, boost::a
 			message.array.push_back(iterator->endpoint().port());
 			message.array.push_back(botID);
 			message.buffer.push_back(iterator->endpoint().address().to_string());
-			core->messages.push(message);
+			core->pushMessage(message);
 			if (ssl)
 			{
 				secureClientSocket.lowest_layer().async_connect(iterator->endpoint(), boost::bind(&Client::handleConnect, shared_from_this(), boost::asio::placeholders::error, iterator));
@@ -296,6 +390,49 @@ void Client::handleConnectTimeoutTimer(const boost::system::error_code &error)
 	}
 }
 
+void Client::handleKeepAliveTimer(const boost::system::error_code &error)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (!error && readPaused && connected)
+	{
+		// Servers only ping clients that have gone quiet, so sending something
+		// keeps the connection alive while the server's own lines wait unread
+		Command(*this, "PING").trailing(nickname).send();
+		startKeepAliveTimer();
+	}
+}
+
+void Client::handleNetSplitTimer(const boost::system::error_code &error)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (!error)
+	{
+		pushNetSplits();
+	}
+}
+
+void Client::handleOutboxTimer(const boost::system::error_code &error)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (!error)
+	{
+		flushOutbox();
+	}
+}
+
+void Client::handleQueryTimer(const boost::system::error_code &error)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (!error && !pendingQueries.empty())
+	{
+		if (pendingQueries.front().expiry <= std::time(NULL))
+		{
+			completeQuery(Data::QueryTimedOut);
+		}
+		startQueryTimer();
+	}
+}
+
 void Client::handleReceiveTimeoutTimer(const boost::system::error_code &error)
 {
 	boost::mutex::scoped_lock lock(core->mutex);
@@ -306,6 +443,44 @@ void Client::handleReceiveTimeoutTimer(const boost::system::error_code &error)
 	}
 }
 
+void Client::handleRelayTimer(const boost::system::error_code &error)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (!error && connected)
+	{
+		boost::posix_time::ptime currentTime = boost::posix_time::microsec_clock::universal_time();
+		std::map<std::pair<std::string, std::string>, Data::RelayBuffer>::iterator r = relayBuffers.begin();
+		while (r != relayBuffers.end())
+		{
+			if (r->second.deadline <= currentTime)
+			{
+				writeMessage(r->first.first.c_str(), r->first.second.c_str(), r->second.text.c_str());
+				relayBuffers.erase(r++);
+			}
+			else
+			{
+				++r;
+			}
+		}
+		startRelayTimer();
+	}
+}
+
+void Client::resetRelayTimer()
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	startRelayTimer();
+}
+
+void Client::handleRejoinTimer(const boost::system::error_code &error)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (!error && connected)
+	{
+		joinChannels();
+	}
+}
+
 void Client::handleResolveTimer(const boost::system::error_code &error)
 {
 	boost::mutex::scoped_lock lock(core->mutex);
@@ -320,164 +495,1628 @@ void Client::handleResolveTimer(const boost::system::error_code &error)
 	}
 }
 
-void Client::sendAsync(const std::string &buffer)
+void Client::handleScheduleTimer(const boost::system::error_code &error)
 {
-	if (writeInProgress)
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (error)
 	{
-		pendingMessages.push(buffer);
+		return;
 	}
-	else
+	std::map<int, SharedClient>::iterator c = core->clients.find(botID);
+	if (c == core->clients.end() || c->second.get() != this)
 	{
-		sentData = buffer;
-		writeInProgress = true;
-		if (ssl)
+		// The bot quit or gave up reconnecting, so nothing will be sent
+		scheduledMessages.clear();
+		return;
+	}
+	boost::posix_time::ptime currentTime = boost::posix_time::microsec_clock::universal_time();
+	std::map<int, Data::ScheduledMessage>::iterator s = scheduledMessages.begin();
+	while (s != scheduledMessages.end())
+	{
+		if (s->second.nextTime > currentTime)
 		{
-			boost::asio::async_write(secureClientSocket, boost::asio::buffer(sentData, sentData.length()), boost::bind(&Client::handleWrite, shared_from_this(), boost::asio::placeholders::error));
+			++s;
+			continue;
 		}
-		else
+		if (!s->second.interval)
 		{
-			boost::asio::async_write(clientSocket, boost::asio::buffer(sentData, sentData.length()), boost::bind(&Client::handleWrite, shared_from_this(), boost::asio::placeholders::error));
+			// A one-off send goes to the outbox like IRC_Say while the bot is
+			// disconnected, and is reported if there is none to hold it
+			if (!sendMessage("PRIVMSG", s->second.target.c_str(), s->second.text.c_str()) && !connected)
+			{
+				logprintf("*** IRC: Bot %d dropped scheduled message %d while disconnected", botID, s->first);
+			}
+			scheduledMessages.erase(s++);
+			continue;
 		}
+		// Recurring sends that fall while the bot is disconnected are skipped,
+		// so they neither pile up in the outbox nor push out what scripts sent
+		if (connected)
+		{
+			sendMessage("PRIVMSG", s->second.target.c_str(), s->second.text.c_str());
+		}
+		// Skip the sends missed while the network thread was held up instead
+		// of making them up in a burst
+		s->second.nextTime += boost::posix_time::milliseconds(s->second.interval);
+		if (s->second.nextTime <= currentTime)
+		{
+			s->second.nextTime = currentTime + boost::posix_time::milliseconds(s->second.interval);
+		}
+		++s;
 	}
+	startScheduleTimer();
 }
 
-bool Client::socketOpen()
+void Client::processData(const char *data, std::size_t length)
 {
-	if (ssl)
+	// A line can span two reads, so the incomplete tail of each read waits
+	// for the rest of it instead of being parsed as a line of its own
+	std::string messageBuffer;
+	messageBuffer.swap(partialLine);
+	messageBuffer.append(data, length);
+	std::size_t locationOfEnd = messageBuffer.rfind('\n');
+	if (locationOfEnd != std::string::npos)
 	{
-		return secureClientSocket.lowest_layer().is_open();
+		partialLine.assign(messageBuffer, locationOfEnd + 1, std::string::npos);
+		messageBuffer.erase(locationOfEnd);
 	}
-	else
+	else if (messageBuffer.length() < MAX_BUFFER)
 	{
-		return clientSocket.is_open();
+		partialLine.swap(messageBuffer);
+		return;
 	}
-}
-
-void Client::startAsync()
-{
-	boost::asio::ip::tcp::resolver::query query(boost::asio::ip::tcp::v4(), remoteAddress, boost::str(boost::format("%1%") % remotePort));
-	resolver.async_resolve(query, boost::bind(&Client::handleResolve, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::iterator));
-	core->clients.insert(std::make_pair(botID, shared_from_this()));
-}
-
-void Client::stopAsync()
-{
-	if (socketOpen())
+	boost::algorithm::erase_all(messageBuffer, "\r");
+	std::vector<std::string> splitBuffer;
+	boost::algorithm::split(splitBuffer, messageBuffer, boost::algorithm::is_any_of("\n"));
+	for (std::vector<std::string>::iterator i = splitBuffer.begin(); i != splitBuffer.end(); ++i)
 	{
-		boost::system::error_code error;
-		if (connected)
+		if (!i->empty())
 		{
-			if (ssl)
+			if (charset != Text::UTF8)
 			{
-				secureClientSocket.lowest_layer().shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+				*i = Text::fromUTF8(*i, charset);
+			}
+			Data::Message message;
+			message.array.push_back(Data::OnReceiveRaw);
+			message.array.push_back(botID);
+			if (i->length() > MAX_BUFFER / 8)
+			{
+				std::string tempBuffer = *i;
+				tempBuffer.resize(MAX_BUFFER / 8);
+				message.buffer.push_back(tempBuffer);
 			}
 			else
 			{
-				clientSocket.shutdown(boost::asio::ip::tcp::socket::shutdown_both, error);
+				message.buffer.push_back(*i);
+			}
+			if (pendingQueries.empty())
+			{
+				core->pushMessage(message);
+				parseBuffer(*i);
+				continue;
+			}
+			// Lines that answer a query are only delivered as part of its result
+			queryReply = false;
+			parseBuffer(*i);
+			if (!queryReply)
+			{
+				core->pushMessage(message);
 			}
-			connected = false;
-			pendingChannels.clear();
-			pendingMessages = std::queue<std::string>();
-			users.clear();
-			writeInProgress = false;
-		}
-		if (ssl)
-		{
-			secureClientSocket.lowest_layer().close(error);
-		}
-		else
-		{
-			clientSocket.close(error);
 		}
-		connectTimer.cancel(error);
-		connectTimeoutTimer.cancel(error);
-		receiveTimeoutTimer.cancel(error);
 	}
-	core->clients.erase(botID);
+	if (!splitUsers.empty())
+	{
+		network->removeUsers(splitUsers);
+		splitUsers.clear();
+	}
 }
 
-void Client::startRead()
+bool Client::joinChannel(const std::string &channel, const std::string &key)
 {
-	if (ssl)
+	// Remember the channel so it is rejoined after a reconnect, and leave the
+	// JOIN itself to RPL_WELCOME if the bot is not registered yet
+	Data::DesiredChannel &desiredChannel = desiredChannels[channel];
+	desiredChannel.attempts = 0;
+	desiredChannel.key = key;
+	if (!connected || joinedChannels.find(channel) != joinedChannels.end())
 	{
-		secureClientSocket.async_read_some(boost::asio::buffer(receivedData, MAX_BUFFER), boost::bind(&Client::handleRead, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+		return true;
 	}
-	else
+	desiredChannel.retryTime = std::numeric_limits<std::time_t>::max();
+	Command command(*this, "JOIN");
+	command.parameter(channel);
+	if (!key.empty())
 	{
-		clientSocket.async_read_some(boost::asio::buffer(receivedData, MAX_BUFFER), boost::bind(&Client::handleRead, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+		command.parameter(key);
 	}
+	return command.send();
 }
 
-void Client::startConnectTimer(boost::asio::ip::tcp::resolver::iterator iterator)
+void Client::partChannel(const std::string &channel)
 {
-	if (!localAddress.empty())
+	desiredChannels.erase(channel);
+	rejoinChannels.erase(channel);
+}
+
+int Client::scheduleMessage(const std::string &target, const std::string &text, int delay, int interval)
+{
+	Data::ScheduledMessage &scheduledMessage = scheduledMessages[++lastScheduleID];
+	scheduledMessage.interval = interval;
+	scheduledMessage.nextTime = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(delay);
+	scheduledMessage.target = target;
+	scheduledMessage.text = text;
+	// Scripts call this from the game thread, so the timer is set on the
+	// network thread along with every other timer
+	core->io_service.post(boost::bind(&Client::resetScheduleTimer, shared_from_this()));
+	return lastScheduleID;
+}
+
+bool Client::cancelScheduledMessage(int scheduleID)
+{
+	// The timer is left to run out and rearm itself for what remains
+	return scheduledMessages.erase(scheduleID) != 0;
+}
+
+void Client::resetOutboxTimer()
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	flushOutbox();
+}
+
+void Client::resetScheduleTimer()
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	startScheduleTimer();
+}
+
+bool Client::sendMessage(const char *command, const char *target, const char *text)
+{
+	// Messages for a target that already has some waiting in the outbox queue
+	// up behind them so they are still delivered in order
+	if (!connected || !isTargetReady(target))
 	{
-		boost::system::error_code error;
-		boost::asio::ip::address address(boost::asio::ip::address::from_string(localAddress, error));
-		if (error)
+		if (outboxSize && !quitting)
 		{
-			logprintf("*** IRC Plugin: Error using supplied local address: %s", error.message().c_str());
+			return queueMessage(command, target, text);
 		}
-		if (ssl)
+		if (!connected)
 		{
-			secureClientSocket.lowest_layer().open(boost::asio::ip::tcp::v4(), error);
+			return false;
 		}
-		else
+	}
+	if (outboxSize && !outbox.empty())
+	{
+		for (std::list<Data::OutboxMessage>::iterator m = outbox.begin(); m != outbox.end(); ++m)
 		{
-			clientSocket.open(boost::asio::ip::tcp::v4(), error);
+			if (m->target == target)
+			{
+				return queueMessage(command, target, text);
+			}
 		}
-		if (error)
+	}
+	if (relayWindow && (!std::strcmp(command, "PRIVMSG") || !std::strcmp(command, "NOTICE")))
+	{
+		return relayMessage(command, target, text);
+	}
+	return writeMessage(command, target, text);
+}
+
+bool Client::writeMessage(const char *command, const char *target, const char *text)
+{
+	const char *message = text;
+	std::size_t messageLength = std::strlen(text), bufferStart = outboundBuffer.length();
+	bool valid = true;
+	// Transcode before splitting so the line budget is measured in the bytes
+	// actually sent
+	if (charset != Text::UTF8)
+	{
+		transcodedMessage.clear();
+		Text::appendUTF8(transcodedMessage, text, messageLength, charset);
+		message = transcodedMessage.data();
+		messageLength = transcodedMessage.length();
+	}
+	std::size_t start = 0;
+	while (true)
+	{
+		Command line(*this, command);
+		line.parameter(target);
+		std::size_t budget = getMessageBudget(line.length() + 2);
+		if (messageLength - start <= budget)
 		{
-			logprintf("*** IRC Plugin: Error opening socket: %s", error.message().c_str());
+			line.append(" :", 2).append(message + start, messageLength - start, true);
+			valid = line.send(false);
+			break;
 		}
-		boost::asio::ip::tcp::endpoint endpoint(address, 0);
-		if (ssl)
+		std::size_t end = start + budget, next = 0, locationOfSpace = end;
+		while (locationOfSpace > start && message[locationOfSpace] != ' ')
 		{
-			secureClientSocket.lowest_layer().bind(endpoint, error);
+			--locationOfSpace;
+		}
+		if (locationOfSpace > start)
+		{
+			end = locationOfSpace;
+			next = end + 1;
 		}
 		else
 		{
-			clientSocket.bind(endpoint, error);
+			// No word boundary, so cut before a UTF-8 continuation byte instead
+			while (end > start && (static_cast<unsigned char>(message[end]) & 0xC0) == 0x80)
+			{
+				--end;
+			}
+			if (end == start)
+			{
+				end = start + budget;
+			}
+			next = end;
 		}
-		if (error)
+		line.append(" :", 2).append(message + start, end - start, true);
+		if (!line.send(false))
 		{
-			logprintf("*** IRC Plugin: Error binding local address to socket: %s", error.message().c_str());
+			valid = false;
+			break;
 		}
+		start = next;
 	}
-	connectTimer.expires_from_now(boost::posix_time::seconds(connectDelay));
-	if (currentConnectAttempts < connectAttempts)
-	{
-		++currentConnectAttempts;
-		connectTimer.async_wait(boost::bind(&Client::handleConnectTimer, shared_from_this(), boost::asio::placeholders::error, iterator));
-	}
-	else
+	if (!valid)
 	{
-		currentConnectAttempts = 1;
-		connectTimer.async_wait(boost::bind(&Client::handleConnectTimer, shared_from_this(), boost::asio::placeholders::error, ++iterator));
+		// Command logs the rejected line, and the lines before it are taken
+		// back so that no part of the message goes out
+		outboundBuffer.resize(bufferStart);
+		return false;
 	}
-	core->clients.insert(std::make_pair(botID, shared_from_this()));
+	flushAsync();
+	return true;
 }
 
-void Client::startConnectTimeoutTimer()
+std::size_t Client::getMessageBudget(std::size_t prefixLength)
 {
-	connectTimeoutTimer.expires_from_now(boost::posix_time::seconds(connectTimeout));
-	connectTimeoutTimer.async_wait(boost::bind(&Client::handleConnectTimeoutTimer, shared_from_this(), boost::asio::placeholders::error));
+	// Servers relay the line with our own prefix prepended, so reserve room for
+	// it as well; until the server has shown it to us, assume the longest host
+	std::size_t sourceLength = nickname.length() + 3;
+	if (!ownHost.empty())
+	{
+		sourceLength += ownHost.length();
+	}
+	else
+	{
+		sourceLength += username.length() + MAX_HOST_LENGTH + 2;
+	}
+	if (MAX_LINE_LENGTH - 2 > prefixLength + sourceLength + 32)
+	{
+		return MAX_LINE_LENGTH - 2 - prefixLength - sourceLength;
+	}
+	return 32;
 }
 
-void Client::startReceiveTimeoutTimer()
+bool Client::relayMessage(const char *command, const char *target, const char *text)
+{
+	// Short messages to the same target are joined into one line, which goes
+	// out once it is full or the window since the first of them has passed
+	std::size_t textLength = std::strlen(text);
+	if (!Command::isValid(text, textLength))
+	{
+		// Joined to others it would take them down with it, so let Command
+		// reject it on its own
+		return writeMessage(command, target, text);
+	}
+	std::size_t limit = getMessageBudget(std::strlen(command) + std::strlen(target) + 3);
+	if (relaySize && relaySize < limit)
+	{
+		limit = relaySize;
+	}
+	std::pair<std::string, std::string> key(command, target);
+	std::map<std::pair<std::string, std::string>, Data::RelayBuffer>::iterator r = relayBuffers.find(key);
+	if (r != relayBuffers.end() && r->second.text.length() + std::strlen(RELAY_SEPARATOR) + textLength > limit)
+	{
+		writeMessage(command, target, r->second.text.c_str());
+		relayBuffers.erase(r);
+		r = relayBuffers.end();
+	}
+	if (textLength >= limit)
+	{
+		return writeMessage(command, target, text);
+	}
+	if (r == relayBuffers.end())
+	{
+		Data::RelayBuffer &relayBuffer = relayBuffers[key];
+		relayBuffer.deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::milliseconds(relayWindow);
+		relayBuffer.text.assign(text, textLength);
+		if (relayBuffers.size() == 1)
+		{
+			core->io_service.post(boost::bind(&Client::resetRelayTimer, shared_from_this()));
+		}
+	}
+	else
+	{
+		r->second.text.append(RELAY_SEPARATOR).append(text, textLength);
+	}
+	return true;
+}
+
+void Client::flushRelayBuffers()
+{
+	for (std::map<std::pair<std::string, std::string>, Data::RelayBuffer>::iterator r = relayBuffers.begin(); r != relayBuffers.end(); ++r)
+	{
+		if (connected)
+		{
+			writeMessage(r->first.first.c_str(), r->first.second.c_str(), r->second.text.c_str());
+		}
+		else if (outboxSize)
+		{
+			queueMessage(r->first.first.c_str(), r->first.second.c_str(), r->second.text.c_str());
+		}
+	}
+	relayBuffers.clear();
+}
+
+bool Client::sendMessage(const char *command, const std::vector<std::string> &targets, const char *text)
+{
+	// Pack targets into comma-separated lists so one line reaches several
+	// channels, keeping the list short enough to leave room for the message
+	std::size_t limit = getTargetLimit(command), count = 0;
+	bool sent = false;
+	std::string list;
+	for (std::vector<std::string>::const_iterator t = targets.begin(); t != targets.end(); ++t)
+	{
+		if (t->empty())
+		{
+			continue;
+		}
+		if (count && (count >= limit || list.length() + t->length() + 1 > MAX_LINE_LENGTH / 4))
+		{
+			if (!sendMessage(command, list.c_str(), text))
+			{
+				return false;
+			}
+			sent = true;
+			list.clear();
+			count = 0;
+		}
+		if (count)
+		{
+			list.push_back(',');
+		}
+		list.append(*t);
+		++count;
+	}
+	if (count)
+	{
+		return sendMessage(command, list.c_str(), text);
+	}
+	return sent;
+}
+
+void Client::cancelQueries(int scriptID)
+{
+	// The replies are still on their way, so the queries stay queued to
+	// consume them and are discarded once complete
+	for (std::deque<Data::Query>::iterator q = pendingQueries.begin(); q != pendingQueries.end(); ++q)
+	{
+		if (q->scriptID == scriptID)
+		{
+			q->scriptID = -1;
+		}
+	}
+}
+
+bool Client::sendQuery(const Data::Query &query)
+{
+	if (!connected || query.target.find(' ') != std::string::npos || query.argument.find(' ') != std::string::npos)
+	{
+		return false;
+	}
+	bool sent = false;
+	switch (query.type)
+	{
+		case Data::WhoisQuery:
+		{
+			sent = Command(*this, "WHOIS").parameter(query.target).send();
+			break;
+		}
+		case Data::WhoQuery:
+		{
+			sent = Command(*this, "WHO").parameter(query.target).send();
+			break;
+		}
+		case Data::ListQuery:
+		{
+			// Let the server do as much of the filtering as ELIST says it can;
+			// the replies are filtered again as they arrive either way
+			std::string conditions, elist;
+			std::map<std::string, std::string>::iterator s = serverSupport.find("ELIST");
+			if (s != serverSupport.end())
+			{
+				elist = boost::algorithm::to_upper_copy(s->second);
+			}
+			if (elist.find('U') != std::string::npos)
+			{
+				if (query.minUsers > 0)
+				{
+					conditions = ">" + boost::lexical_cast<std::string>(query.minUsers - 1);
+				}
+				if (query.maxUsers > 0)
+				{
+					conditions += (conditions.empty() ? "<" : ",<") + boost::lexical_cast<std::string>(query.maxUsers + 1);
+				}
+			}
+			if (!query.argument.empty() && (elist.find('M') != std::string::npos || query.argument.find_first_of("*?") == std::string::npos))
+			{
+				conditions += (conditions.empty() ? "" : ",") + query.argument;
+			}
+			Command command(*this, "LIST");
+			if (!conditions.empty())
+			{
+				command.parameter(conditions);
+			}
+			sent = command.send();
+			break;
+		}
+		case Data::ModeQuery:
+		{
+			Command command(*this, "MODE");
+			command.parameter(query.target);
+			if (!query.argument.empty())
+			{
+				command.parameter(query.argument);
+			}
+			sent = command.send();
+			break;
+		}
+	}
+	if (!sent)
+	{
+		return false;
+	}
+	// Servers answer commands in the order they arrive, so replies always
+	// belong to the query at the front
+	pendingQueries.push_back(query);
+	pendingQueries.back().expiry = std::time(NULL) + QUERY_TIMEOUT;
+	if (pendingQueries.size() == 1)
+	{
+		startQueryTimer();
+	}
+	return true;
+}
+
+void Client::sendAsync(const std::string &buffer)
+{
+	Text::appendUTF8(outboundBuffer, buffer.data(), buffer.length(), charset);
+	flushAsync();
+}
+
+void Client::flushOutbox()
+{
+	std::time_t now = std::time(NULL);
+	boost::posix_time::ptime currentTime = boost::posix_time::microsec_clock::universal_time();
+	if (outboxPenalty < currentTime)
+	{
+		outboxPenalty = currentTime;
+	}
+	boost::posix_time::ptime nextTime = boost::posix_time::pos_infin;
+	// The MODE and WHO for each newly joined channel come first and share the
+	// flood budget with the outbox, one OUTBOX_INTERVAL per channel
+	while (!pendingChannelQueries.empty())
+	{
+		if (outboxPenalty > currentTime + boost::posix_time::milliseconds(OUTBOX_WINDOW))
+		{
+			nextTime = outboxPenalty - boost::posix_time::milliseconds(OUTBOX_WINDOW);
+			break;
+		}
+		const std::string &channel = pendingChannelQueries.front();
+		if (joinedChannels.find(channel) != joinedChannels.end())
+		{
+			Command(*this, "MODE").parameter(channel).send(false);
+			if (serverSupport.find("WHOX") != serverSupport.end())
+			{
+				Command(*this, "WHO").parameter(channel).parameter("%tcuhnfa," WHOX_TOKEN).send();
+			}
+			else
+			{
+				Command(*this, "WHO").parameter(channel).send();
+			}
+			pendingWho.insert(channel);
+			outboxPenalty += boost::posix_time::milliseconds(OUTBOX_INTERVAL);
+		}
+		pendingChannelQueries.pop_front();
+	}
+	std::size_t expired = 0;
+	std::list<Data::OutboxMessage>::iterator m = outbox.begin();
+	while (m != outbox.end())
+	{
+		if (m->expiry <= now)
+		{
+			m = outbox.erase(m);
+			++expired;
+			continue;
+		}
+		if (!isTargetReady(m->target))
+		{
+			++m;
+			continue;
+		}
+		// Every replayed message costs OUTBOX_INTERVAL, and at most OUTBOX_WINDOW
+		// may be outstanding, so a reconnect does not trip the server's flood
+		// protection
+		if (outboxPenalty > currentTime + boost::posix_time::milliseconds(OUTBOX_WINDOW))
+		{
+			nextTime = outboxPenalty - boost::posix_time::milliseconds(OUTBOX_WINDOW);
+			break;
+		}
+		writeMessage(m->command.c_str(), m->target.c_str(), m->text.c_str());
+		outboxPenalty += boost::posix_time::milliseconds(OUTBOX_INTERVAL);
+		m = outbox.erase(m);
+	}
+	if (expired)
+	{
+		logprintf("*** IRC: Bot %d dropped %u expired outbox message(s)", botID, static_cast<unsigned>(expired));
+	}
+	if (outbox.empty() && pendingChannelQueries.empty())
+	{
+		return;
+	}
+	// Wake up again when the next message expires, even if its target is
+	// never ready, so nothing lingers until the outbox overflows
+	for (m = outbox.begin(); m != outbox.end(); ++m)
+	{
+		nextTime = std::min(nextTime, currentTime + boost::posix_time::seconds(static_cast<long>(m->expiry - now)));
+	}
+	outboxTimer.expires_at(nextTime);
+	outboxTimer.async_wait(boost::bind(&Client::handleOutboxTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::joinChannels()
+{
+	// Channels with keys go first so the key list lines up with the start of
+	// the channel list
+	std::vector<std::string> joinList, unkeyedJoinList;
+	std::time_t now = std::time(NULL), nextRetryTime = 0;
+	for (std::map<std::string, Data::DesiredChannel>::iterator d = desiredChannels.begin(); d != desiredChannels.end(); ++d)
+	{
+		if (joinedChannels.find(d->first) != joinedChannels.end())
+		{
+			continue;
+		}
+		if (d->second.retryTime > now)
+		{
+			if (d->second.retryTime != std::numeric_limits<std::time_t>::max() && (!nextRetryTime || d->second.retryTime < nextRetryTime))
+			{
+				nextRetryTime = d->second.retryTime;
+			}
+			continue;
+		}
+		d->second.retryTime = std::numeric_limits<std::time_t>::max();
+		if (d->second.key.empty())
+		{
+			unkeyedJoinList.push_back(d->first);
+		}
+		else
+		{
+			joinList.push_back(d->first);
+		}
+	}
+	joinList.insert(joinList.end(), unkeyedJoinList.begin(), unkeyedJoinList.end());
+	std::size_t limit = std::numeric_limits<std::size_t>::max(), count = 0;
+	if (serverSupport.find("TARGMAX") != serverSupport.end())
+	{
+		limit = getTargetLimit("JOIN");
+	}
+	std::string channelList, keyList;
+	for (std::vector<std::string>::iterator j = joinList.begin(); j != joinList.end(); ++j)
+	{
+		const std::string &key = desiredChannels[*j].key;
+		std::size_t length = std::strlen("JOIN ") + channelList.length() + j->length() + 3;
+		if (!keyList.empty() || !key.empty())
+		{
+			length += keyList.length() + key.length() + 2;
+		}
+		if (count && (count >= limit || length > MAX_LINE_LENGTH))
+		{
+			Command command(*this, "JOIN");
+			command.parameter(channelList);
+			if (!keyList.empty())
+			{
+				command.parameter(keyList);
+			}
+			command.send(false);
+			channelList.clear();
+			keyList.clear();
+			count = 0;
+		}
+		if (count)
+		{
+			channelList.push_back(',');
+			if (!key.empty())
+			{
+				keyList.push_back(',');
+			}
+		}
+		channelList.append(*j);
+		keyList.append(key);
+		++count;
+	}
+	if (count)
+	{
+		Command command(*this, "JOIN");
+		command.parameter(channelList);
+		if (!keyList.empty())
+		{
+			command.parameter(keyList);
+		}
+		command.send(false);
+		flushAsync();
+	}
+	if (nextRetryTime)
+	{
+		rejoinTimer.expires_from_now(boost::posix_time::seconds(static_cast<long>(nextRetryTime - now)));
+		rejoinTimer.async_wait(boost::bind(&Client::handleRejoinTimer, shared_from_this(), boost::asio::placeholders::error));
+	}
+}
+
+bool Client::isTargetReady(const std::string &target)
+{
+	if (!connected || rejoinChannels.empty())
+	{
+		return connected;
+	}
+	// Channels the bot was in before it disconnected are held until it has
+	// joined them again; anything else can be sent once it is registered
+	std::vector<std::string> targets;
+	boost::algorithm::split(targets, target, boost::algorithm::is_any_of(","));
+	for (std::vector<std::string>::iterator t = targets.begin(); t != targets.end(); ++t)
+	{
+		if (joinedChannels.find(*t) == joinedChannels.end() && rejoinChannels.find(*t) != rejoinChannels.end())
+		{
+			return false;
+		}
+	}
+	return true;
+}
+
+bool Client::queueMessage(const char *command, const char *target, const char *text)
+{
+	std::time_t now = std::time(NULL);
+	std::size_t dropped = 0;
+	while (!outbox.empty() && (outbox.front().expiry <= now || outbox.size() >= outboxSize))
+	{
+		outbox.pop_front();
+		++dropped;
+	}
+	if (dropped)
+	{
+		logprintf("*** IRC: Bot %d dropped %u outbox message(s)", botID, static_cast<unsigned>(dropped));
+	}
+	if (outbox.empty())
+	{
+		// Natives call this from the game thread, so the expiry timer is set
+		// on the network thread
+		core->io_service.post(boost::bind(&Client::resetOutboxTimer, shared_from_this()));
+	}
+	Data::OutboxMessage message;
+	message.command = command;
+	message.expiry = now + outboxTTL;
+	message.target = target;
+	message.text = text;
+	outbox.push_back(message);
+	return true;
+}
+
+void Client::flushAsync()
+{
+	// Lines queued by natives are written from the network thread, so a burst
+	// of calls is coalesced into one write instead of each making a system call
+	if (!writeInProgress && !flushPending && !outboundBuffer.empty())
+	{
+		flushPending = true;
+		clientSocket.get_io_service().post(boost::bind(&Client::handleFlush, shared_from_this()));
+	}
+}
+
+void Client::handleFlush()
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	flushPending = false;
+	startWrite();
+}
+
+void Client::startWrite()
+{
+	TRACE_SPAN("Client::startWrite");
+	if (!writeInProgress && !outboundBuffer.empty())
+	{
+		// Swap instead of copying so both buffers keep their capacity and
+		// steady-state sends do not allocate
+		sentData.clear();
+		sentData.swap(outboundBuffer);
+		writeInProgress = true;
+		if (ssl)
+		{
+			boost::asio::async_write(secureClientSocket, boost::asio::buffer(sentData, sentData.length()), boost::bind(&Client::handleWrite, shared_from_this(), boost::asio::placeholders::error));
+		}
+		else
+		{
+			boost::asio::async_write(clientSocket, boost::asio::buffer(sentData, sentData.length()), boost::bind(&Client::handleWrite, shared_from_this(), boost::asio::placeholders::error));
+		}
+	}
+}
+
+bool Client::socketOpen()
+{
+	if (ssl)
+	{
+		return secureClientSocket.lowest_layer().is_open();
+	}
+	else
+	{
+		return clientSocket.is_open();
+	}
+}
+
+void Client::startAsync()
+{
+	boost::asio::ip::tcp::resolver::query query(boost::asio::ip::tcp::v4(), remoteAddress, boost::lexical_cast<std::string>(remotePort));
+	resolver.async_resolve(query, boost::bind(&Client::handleResolve, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+	core->clients.insert(std::make_pair(botID, shared_from_this()));
+}
+
+void Client::stopAsync()
+{
+	if (socketOpen())
+	{
+		boost::system::error_code error;
+		if (connected)
+		{
+			// Give anything still queued, such as a QUIT, a chance to go out.
+			// When quitting behind a write in flight, stop reading but leave
+			// the rest for handleWrite to send before it closes the socket.
+			startWrite();
+			closing = quitting && writeInProgress;
+			if (ssl)
+			{
+				secureClientSocket.lowest_layer().shutdown(closing ? boost::asio::ip::tcp::socket::shutdown_receive : boost::asio::ip::tcp::socket::shutdown_both, error);
+			}
+			else
+			{
+				clientSocket.shutdown(closing ? boost::asio::ip::tcp::socket::shutdown_receive : boost::asio::ip::tcp::socket::shutdown_both, error);
+			}
+			connected = false;
+			flushRelayBuffers();
+			capabilities.clear();
+			offeredCapabilities.clear();
+			ownHost.clear();
+			pendingChannels.clear();
+			pendingChannelQueries.clear();
+			pendingWho.clear();
+			while (!pendingQueries.empty())
+			{
+				completeQuery(Data::QueryDisconnected);
+			}
+			netSplits.clear();
+			pendingNetJoins.clear();
+			pendingNetSplits.clear();
+			splitUsers.clear();
+			// Only channels that joinChannels will try again are worth holding
+			// messages for
+			rejoinChannels.clear();
+			for (std::set<std::string>::iterator j = joinedChannels.begin(); j != joinedChannels.end(); ++j)
+			{
+				if (desiredChannels.find(*j) != desiredChannels.end())
+				{
+					rejoinChannels.insert(*j);
+				}
+			}
+			sharedNames.clear();
+			detachNetwork();
+			serverSupport.clear();
+		}
+		if (!closing)
+		{
+			outboundBuffer.clear();
+			writeInProgress = false;
+			if (ssl)
+			{
+				secureClientSocket.lowest_layer().close(error);
+			}
+			else
+			{
+				clientSocket.close(error);
+			}
+		}
+		connectTimer.cancel(error);
+		connectTimeoutTimer.cancel(error);
+		keepAliveTimer.cancel(error);
+		netSplitTimer.cancel(error);
+		outboxTimer.cancel(error);
+		queryTimer.cancel(error);
+		receiveTimeoutTimer.cancel(error);
+		relayTimer.cancel(error);
+		rejoinTimer.cancel(error);
+		if (!outbox.empty() && !quitting)
+		{
+			// Held messages still have to expire while the bot reconnects
+			core->io_service.post(boost::bind(&Client::resetOutboxTimer, shared_from_this()));
+		}
+	}
+	if (quitting)
+	{
+		// Scheduled messages outlive reconnects but not the bot itself, and
+		// a pending wait would otherwise keep the client alive
+		boost::system::error_code error;
+		scheduleTimer.cancel(error);
+		scheduledMessages.clear();
+	}
+	partialLine.clear();
+	readPaused = false;
+	core->pausedClients.erase(botID);
+	core->clients.erase(botID);
+}
+
+void Client::pauseRead()
+{
+	// Leave the socket unread until Pawn catches up with the event queue, so
+	// that TCP flow control holds the server back in the meantime
+	boost::system::error_code error;
+	readPaused = true;
+	receiveTimeoutTimer.cancel(error);
+	core->pausedClients.insert(botID);
+	++core->readPauses;
+	startKeepAliveTimer();
+}
+
+void Client::resumeRead()
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (readPaused)
+	{
+		boost::system::error_code error;
+		readPaused = false;
+		keepAliveTimer.cancel(error);
+		if (socketOpen())
+		{
+			startReceiveTimeoutTimer();
+			startRead();
+		}
+	}
+}
+
+void Client::startRead()
+{
+	if (ssl)
+	{
+		secureClientSocket.async_read_some(boost::asio::buffer(receivedData, MAX_BUFFER), boost::bind(&Client::handleRead, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+	}
+	else
+	{
+		clientSocket.async_read_some(boost::asio::buffer(receivedData, MAX_BUFFER), boost::bind(&Client::handleRead, shared_from_this(), boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+	}
+}
+
+void Client::startConnectTimer(boost::asio::ip::tcp::resolver::iterator iterator)
+{
+	if (!localAddress.empty())
+	{
+		boost::system::error_code error;
+		boost::asio::ip::address address(boost::asio::ip::address::from_string(localAddress, error));
+		if (error)
+		{
+			logprintf("*** IRC Plugin: Error using supplied local address: %s", error.message().c_str());
+		}
+		if (ssl)
+		{
+			secureClientSocket.lowest_layer().open(boost::asio::ip::tcp::v4(), error);
+		}
+		else
+		{
+			clientSocket.open(boost::asio::ip::tcp::v4(), error);
+		}
+		if (error)
+		{
+			logprintf("*** IRC Plugin: Error opening socket: %s", error.message().c_str());
+		}
+		boost::asio::ip::tcp::endpoint endpoint(address, 0);
+		if (ssl)
+		{
+			secureClientSocket.lowest_layer().bind(endpoint, error);
+		}
+		else
+		{
+			clientSocket.bind(endpoint, error);
+		}
+		if (error)
+		{
+			logprintf("*** IRC Plugin: Error binding local address to socket: %s", error.message().c_str());
+		}
+	}
+	connectTimer.expires_from_now(boost::posix_time::seconds(connectDelay));
+	if (currentConnectAttempts < connectAttempts)
+	{
+		++currentConnectAttempts;
+		connectTimer.async_wait(boost::bind(&Client::handleConnectTimer, shared_from_this(), boost::asio::placeholders::error, iterator));
+	}
+	else
+	{
+		currentConnectAttempts = 1;
+		connectTimer.async_wait(boost::bind(&Client::handleConnectTimer, shared_from_this(), boost::asio::placeholders::error, ++iterator));
+	}
+	core->clients.insert(std::make_pair(botID, shared_from_this()));
+}
+
+void Client::startConnectTimeoutTimer()
+{
+	connectTimeoutTimer.expires_from_now(boost::posix_time::seconds(connectTimeout));
+	connectTimeoutTimer.async_wait(boost::bind(&Client::handleConnectTimeoutTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::startKeepAliveTimer()
+{
+	keepAliveTimer.expires_from_now(boost::posix_time::seconds(KEEPALIVE_INTERVAL));
+	keepAliveTimer.async_wait(boost::bind(&Client::handleKeepAliveTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::startNetSplitTimer()
+{
+	netSplitTimer.expires_from_now(boost::posix_time::milliseconds(NETSPLIT_DELAY));
+	netSplitTimer.async_wait(boost::bind(&Client::handleNetSplitTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::startQueryTimer()
+{
+	if (!pendingQueries.empty())
+	{
+		queryTimer.expires_from_now(boost::posix_time::seconds(std::max<long>(pendingQueries.front().expiry - std::time(NULL), 0)));
+		queryTimer.async_wait(boost::bind(&Client::handleQueryTimer, shared_from_this(), boost::asio::placeholders::error));
+	}
+}
+
+void Client::startReceiveTimeoutTimer()
 {
 	receiveTimeoutTimer.expires_from_now(boost::posix_time::seconds(receiveTimeout));
 	receiveTimeoutTimer.async_wait(boost::bind(&Client::handleReceiveTimeoutTimer, shared_from_this(), boost::asio::placeholders::error));
 }
 
-void Client::startResolveTimer()
+void Client::startRelayTimer()
+{
+	if (relayBuffers.empty())
+	{
+		return;
+	}
+	boost::posix_time::ptime deadline = boost::posix_time::pos_infin;
+	for (std::map<std::pair<std::string, std::string>, Data::RelayBuffer>::iterator r = relayBuffers.begin(); r != relayBuffers.end(); ++r)
+	{
+		deadline = std::min(deadline, r->second.deadline);
+	}
+	relayTimer.expires_at(deadline);
+	relayTimer.async_wait(boost::bind(&Client::handleRelayTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::startResolveTimer()
+{
+	resolveTimer.expires_from_now(boost::posix_time::seconds(connectTimeout));
+	resolveTimer.async_wait(boost::bind(&Client::handleResolveTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::startScheduleTimer()
+{
+	if (scheduledMessages.empty())
+	{
+		return;
+	}
+	boost::posix_time::ptime nextTime = boost::posix_time::pos_infin;
+	for (std::map<int, Data::ScheduledMessage>::iterator s = scheduledMessages.begin(); s != scheduledMessages.end(); ++s)
+	{
+		nextTime = std::min(nextTime, s->second.nextTime);
+	}
+	scheduleTimer.expires_at(nextTime);
+	scheduleTimer.async_wait(boost::bind(&Client::handleScheduleTimer, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void Client::attachNetwork()
+{
+	if (!networkName.empty())
+	{
+		return;
+	}
+	// Bots on the same network share one copy of its channel state, as long as
+	// they agree on how names compare and are transcoded
+	networkName = connectedAddress;
+	std::map<std::string, std::string>::iterator f = serverSupport.find("NETWORK");
+	if (f != serverSupport.end())
+	{
+		networkName = f->second;
+	}
+	f = serverSupport.find("CASEMAPPING");
+	networkName.append(" ").append(f != serverSupport.end() ? f->second : "rfc1459");
+	networkName.append(" ").append(boost::lexical_cast<std::string>(charset));
+	SharedNetwork &sharedNetwork = core->networks[networkName];
+	if (!sharedNetwork)
+	{
+		sharedNetwork.reset(new Network);
+		f = serverSupport.find("PREFIX");
+		if (f != serverSupport.end())
+		{
+			sharedNetwork->setRankPrefixes(f->second);
+		}
+	}
+	network = sharedNetwork;
+}
+
+void Client::detachNetwork()
+{
+	for (std::set<std::string>::iterator j = joinedChannels.begin(); j != joinedChannels.end(); ++j)
+	{
+		network->removeChannelReference(*j, botID);
+	}
+	joinedChannels.clear();
+	if (!networkName.empty())
+	{
+		std::map<std::string, SharedNetwork>::iterator n = core->networks.find(networkName);
+		if (n != core->networks.end() && n->second.use_count() <= 2)
+		{
+			core->networks.erase(n);
+		}
+		networkName.clear();
+	}
+	network.reset(new Network);
+}
+
+void Client::removeChannel(const std::string &channel)
+{
+	joinedChannels.erase(channel);
+	rejoinChannels.erase(channel);
+	network->removeChannelReference(channel, botID);
+}
+
+bool Client::isGroupLeader(const std::string &channel)
+{
+	if (!groupID)
+	{
+		return true;
+	}
+	return isGroupLeader(std::vector<std::string>(1, channel));
+}
+
+bool Client::isGroupLeader(const std::vector<std::string> &eventChannels)
+{
+	// Every bot in a group sees the same channel events, so only the connected
+	// member with the lowest ID that is in one of the event's channels reports
+	// them. Leadership moves on by itself when that bot disconnects or leaves.
+	GroupMap::iterator f = core->groups.find(groupID);
+	if (f == core->groups.end())
+	{
+		return true;
+	}
+	for (std::map<int, bool>::iterator g = f->second.begin(); g != f->second.end(); ++g)
+	{
+		if (g->first == botID)
+		{
+			return true;
+		}
+		std::map<int, SharedClient>::iterator c = core->clients.find(g->first);
+		if (c != core->clients.end() && c->second->connected)
+		{
+			for (std::vector<std::string>::const_iterator e = eventChannels.begin(); e != eventChannels.end(); ++e)
+			{
+				if (c->second->joinedChannels.find(*e) != c->second->joinedChannels.end())
+				{
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+bool Client::isUserGroupLeader(const std::string &user)
+{
+	// Quits and nick changes have no channel, so use the channels this bot
+	// shares with the user; membership of the bots themselves does not depend
+	// on which of them has processed the line first
+	if (!groupID)
+	{
+		return true;
+	}
+	return isGroupLeader(network->getUserChannels(user));
+}
+
+bool Client::isNetSplit(const std::string &reason)
+{
+	// Servers quit users lost in a netsplit with the names of the two servers
+	// either side of the broken link, such as "hub.example.net leaf.example.net"
+	// or "*.net *.split" where server names are hidden. Not every server
+	// prefixes ordinary quit messages, so a lone user can still look like
+	// this, which pushNetSplits reports as an ordinary quit.
+	std::size_t locationOfSpace = reason.find(' ');
+	if (locationOfSpace == std::string::npos || reason.find(' ', locationOfSpace + 1) != std::string::npos)
+	{
+		return false;
+	}
+	std::string servers[2] = { reason.substr(0, locationOfSpace), reason.substr(locationOfSpace + 1) };
+	for (std::size_t i = 0; i < 2; ++i)
+	{
+		if (servers[i].length() < 3 || servers[i].find('.') == std::string::npos || servers[i].at(0) == '.' || servers[i].at(servers[i].length() - 1) == '.')
+		{
+			return false;
+		}
+		if (servers[i].find_first_not_of("*-.0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz") != std::string::npos)
+		{
+			return false;
+		}
+	}
+	return servers[0] != servers[1];
+}
+
+void Client::pushNetSplits()
+{
+	// Every bot in a group sees the same split, so it is only reported by the
+	// leader of the channels it touched, like the events it was made from
+	for (std::map<std::string, Data::NetSplit>::iterator s = pendingNetSplits.begin(); s != pendingNetSplits.end(); ++s)
+	{
+		if (s->second.users.size() < 2)
+		{
+			// A split takes at least two users with it, so a single quit with
+			// a reason that looks like one is reported and forgotten as usual
+			std::map<std::string, Data::NetSplit>::iterator n = netSplits.find(s->first);
+			if (n != netSplits.end())
+			{
+				n->second.users.erase(*s->second.users.begin());
+			}
+			if (!groupID || isGroupLeader(std::vector<std::string>(s->second.channels.begin(), s->second.channels.end())))
+			{
+				Data::Message message;
+				message.array.push_back(Data::OnUserDisconnect);
+				message.array.push_back(botID);
+				message.buffer.push_back(s->first);
+				message.buffer.push_back(s->second.host);
+				message.buffer.push_back(*s->second.users.begin());
+				core->pushMessage(message);
+			}
+			continue;
+		}
+		if (groupID && !isGroupLeader(std::vector<std::string>(s->second.channels.begin(), s->second.channels.end())))
+		{
+			continue;
+		}
+		std::size_t locationOfSpace = s->first.find(' ');
+		Data::Message message;
+		message.array.push_back(Data::OnNetSplit);
+		message.array.push_back(botID);
+		message.array.push_back(static_cast<int>(s->second.users.size()));
+		message.buffer.push_back(s->first.substr(0, locationOfSpace));
+		message.buffer.push_back(s->first.substr(locationOfSpace + 1));
+		message.buffer.push_back(joinNames(s->second.users));
+		message.buffer.push_back(joinNames(s->second.channels));
+		core->pushMessage(message);
+	}
+	pendingNetSplits.clear();
+	for (std::map<std::string, Data::NetSplit>::iterator j = pendingNetJoins.begin(); j != pendingNetJoins.end(); ++j)
+	{
+		if (!groupID || isGroupLeader(std::vector<std::string>(j->second.channels.begin(), j->second.channels.end())))
+		{
+			std::size_t locationOfSpace = j->first.find(' ');
+			Data::Message message;
+			message.array.push_back(Data::OnNetJoin);
+			message.array.push_back(botID);
+			message.array.push_back(static_cast<int>(j->second.users.size()));
+			message.buffer.push_back(j->first.substr(0, locationOfSpace));
+			message.buffer.push_back(j->first.substr(locationOfSpace + 1));
+			message.buffer.push_back(joinNames(j->second.users));
+			message.buffer.push_back(joinNames(j->second.channels));
+			core->pushMessage(message);
+		}
+		std::map<std::string, Data::NetSplit>::iterator s = netSplits.find(j->first);
+		if (s != netSplits.end())
+		{
+			for (std::set<std::string>::iterator u = j->second.users.begin(); u != j->second.users.end(); ++u)
+			{
+				s->second.users.erase(*u);
+			}
+		}
+	}
+	pendingNetJoins.clear();
+	// Forget users who never came back so their next join is reported normally
+	std::time_t now = std::time(NULL);
+	std::map<std::string, Data::NetSplit>::iterator s = netSplits.begin();
+	while (s != netSplits.end())
+	{
+		if (s->second.users.empty() || s->second.time + NETSPLIT_EXPIRY <= now)
+		{
+			netSplits.erase(s++);
+		}
+		else
+		{
+			++s;
+		}
+	}
+}
+
+int Client::getChannelModeType(char mode)
 {
-	resolveTimer.expires_from_now(boost::posix_time::seconds(connectTimeout));
-	resolveTimer.async_wait(boost::bind(&Client::handleResolveTimer, shared_from_this(), boost::asio::placeholders::error));
+	std::string prefix = DEFAULT_PREFIX;
+	std::map<std::string, std::string>::iterator f = serverSupport.find("PREFIX");
+	if (f != serverSupport.end())
+	{
+		prefix = f->second;
+	}
+	std::size_t locationOfEnd = prefix.find(')');
+	if (!prefix.find('(') && locationOfEnd != std::string::npos && prefix.find(mode) < locationOfEnd)
+	{
+		return PrefixMode;
+	}
+	std::string types = "beI,k,l,imnpst";
+	f = serverSupport.find("CHANMODES");
+	if (f != serverSupport.end())
+	{
+		types = f->second;
+	}
+	int type = ListMode;
+	for (std::string::iterator t = types.begin(); t != types.end(); ++t)
+	{
+		if (*t == ',')
+		{
+			++type;
+		}
+		else if (*t == mode)
+		{
+			return std::min(type, static_cast<int>(FlagMode));
+		}
+	}
+	return FlagMode;
+}
+
+std::size_t Client::getTargetLimit(const char *command)
+{
+	std::map<std::string, std::string>::iterator f = serverSupport.find("TARGMAX");
+	if (f != serverSupport.end())
+	{
+		// TARGMAX=PRIVMSG:4,NOTICE:4,JOIN: (an empty limit means unlimited)
+		std::vector<std::string> limits;
+		boost::algorithm::split(limits, f->second, boost::algorithm::is_any_of(","));
+		for (std::vector<std::string>::iterator l = limits.begin(); l != limits.end(); ++l)
+		{
+			std::size_t locationOfLimit = l->find(':');
+			if (locationOfLimit != std::string::npos && boost::algorithm::iequals(l->substr(0, locationOfLimit), command))
+			{
+				if (locationOfLimit + 1 == l->length())
+				{
+					return std::numeric_limits<std::size_t>::max();
+				}
+				return std::max(std::atoi(l->c_str() + locationOfLimit + 1), 1);
+			}
+		}
+		return 1;
+	}
+	// Older servers advertise a single limit for PRIVMSG and NOTICE
+	f = serverSupport.find("MAXTARGETS");
+	if (f != serverSupport.end())
+	{
+		return std::max(std::atoi(f->second.c_str()), 1);
+	}
+	return 1;
+}
+
+void Client::applyChannelModes(Data::Channel &channel, const std::vector<std::string> &arguments)
+{
+	if (arguments.empty())
+	{
+		return;
+	}
+	bool adding = true;
+	std::size_t argument = 1;
+	for (std::string::const_iterator m = arguments.front().begin(); m != arguments.front().end(); ++m)
+	{
+		switch (*m)
+		{
+			case '+':
+			{
+				adding = true;
+				break;
+			}
+			case '-':
+			{
+				adding = false;
+				break;
+			}
+			default:
+			{
+				std::string value;
+				switch (getChannelModeType(*m))
+				{
+					case PrefixMode:
+					{
+						if (argument < arguments.size())
+						{
+							network->setUserRank(channel.id, arguments.at(argument), *m, adding);
+						}
+						++argument;
+						break;
+					}
+					case ListMode:
+					{
+						++argument;
+						break;
+					}
+					case ParameterMode:
+					{
+						if (argument < arguments.size())
+						{
+							value = arguments.at(argument++);
+						}
+						if (adding)
+						{
+							channel.modes[*m] = value;
+						}
+						else
+						{
+							channel.modes.erase(*m);
+						}
+						break;
+					}
+					case SetParameterMode:
+					{
+						if (adding)
+						{
+							if (argument < arguments.size())
+							{
+								value = arguments.at(argument++);
+							}
+							channel.modes[*m] = value;
+						}
+						else
+						{
+							channel.modes.erase(*m);
+						}
+						break;
+					}
+					case FlagMode:
+					{
+						if (adding)
+						{
+							channel.modes[*m] = value;
+						}
+						else
+						{
+							channel.modes.erase(*m);
+						}
+						break;
+					}
+				}
+				break;
+			}
+		}
+	}
+}
+
+std::string Client::convertFormatting(const std::string &text)
+{
+	switch (formatting)
+	{
+		case Text::StripFormatting:
+		{
+			return Text::stripFormatting(text);
+		}
+		case Text::TranslateFormatting:
+		{
+			return Text::translateFormatting(text);
+		}
+	}
+	return text;
+}
+
+void Client::completeQuery(int error)
+{
+	Data::Query &query = pendingQueries.front();
+	if (query.scriptID < 0)
+	{
+		pendingQueries.pop_front();
+		return;
+	}
+	if (error)
+	{
+		query.error = error;
+	}
+	Data::Message message;
+	message.array.push_back(Data::OnQueryResult);
+	message.array.push_back(botID);
+	message.array.push_back(query.id);
+	message.array.push_back(query.error);
+	message.array.push_back(query.scriptID);
+	message.buffer.push_back(query.target);
+	message.buffer.push_back(query.callback);
+	std::vector<Data::QueryRow> rows;
+	rows.swap(query.rows);
+	Data::Query &result = core->queryResults[query.id] = query;
+	result.rows.swap(rows);
+	pendingQueries.pop_front();
+	core->pushMessage(message);
+}
+
+bool Client::handleQueryReply(int numeric, const std::vector<std::string> &parameters, const std::string &trailing)
+{
+	// Collects the replies to the query at the front of the queue into rows
+	// holding every parameter after our nickname, and returns whether the
+	// numeric was consumed
+	Data::Query &query = pendingQueries.front();
+	bool matchesTarget = parameters.size() >= 2 && boost::algorithm::iequals(parameters.at(1), query.target);
+	bool addRow = false, complete = false;
+	int error = 0;
+	switch (query.type)
+	{
+		case Data::WhoisQuery:
+		{
+			if (!matchesTarget)
+			{
+				return false;
+			}
+			if (numeric == RPL_ENDOFWHOIS)
+			{
+				complete = true;
+			}
+			else if (numeric == ERR_NOSUCHNICK || numeric == ERR_NOSUCHSERVER)
+			{
+				// The end of the WHOIS still follows
+				query.error = numeric;
+			}
+			else if (numeric == 276 || (numeric >= 300 && numeric < 400) || (numeric >= 600 && numeric < 700))
+			{
+				addRow = true;
+			}
+			else
+			{
+				return false;
+			}
+			break;
+		}
+		case Data::WhoQuery:
+		{
+			if (numeric == RPL_WHOREPLY)
+			{
+				// Replies to any other WHO sent in the meantime, such as the
+				// WHOX after a join or a raw WHO from a script, are left alone.
+				// A mask matches against the user, host, server, or nick.
+				if (!matchesTarget)
+				{
+					if (parameters.size() < 6)
+					{
+						return false;
+					}
+					for (std::size_t i = 2; i <= 5 && !matchesTarget; ++i)
+					{
+						matchesTarget = matchesMask(query.target.c_str(), parameters.at(i).c_str());
+					}
+					if (!matchesTarget)
+					{
+						return false;
+					}
+				}
+				addRow = true;
+			}
+			else if (numeric == RPL_ENDOFWHO && matchesTarget)
+			{
+				complete = true;
+			}
+			else if ((numeric == RPL_TRYAGAIN && parameters.size() >= 2 && parameters.at(1) == "WHO") || numeric == ERR_TOOMANYMATCHES)
+			{
+				error = numeric;
+			}
+			else
+			{
+				return false;
+			}
+			break;
+		}
+		case Data::ListQuery:
+		{
+			if (numeric == RPL_LIST)
+			{
+				// Filter as the replies stream in, since a full LIST can run to
+				// tens of thousands of channels
+				if (parameters.size() >= 3)
+				{
+					int users = std::atoi(parameters.at(2).c_str());
+					addRow = users >= query.minUsers && (!query.maxUsers || users <= query.maxUsers) && (query.argument.empty() || matchesMask(query.argument.c_str(), parameters.at(1).c_str()));
+				}
+			}
+			else if (numeric == RPL_LISTEND)
+			{
+				complete = true;
+			}
+			else if ((numeric == RPL_TRYAGAIN && parameters.size() >= 2 && parameters.at(1) == "LIST") || numeric == ERR_TOOMANYMATCHES)
+			{
+				error = numeric;
+			}
+			else if (numeric != RPL_LISTSTART)
+			{
+				return false;
+			}
+			break;
+		}
+		case Data::ModeQuery:
+		{
+			int listReply = RPL_CHANNELMODEIS, endReply = 0;
+			switch (query.argument.empty() ? 0 : query.argument.at(0))
+			{
+				case 'b':
+				{
+					listReply = RPL_BANLIST;
+					endReply = RPL_ENDOFBANLIST;
+					break;
+				}
+				case 'e':
+				{
+					listReply = RPL_EXCEPTLIST;
+					endReply = RPL_ENDOFEXCEPTLIST;
+					break;
+				}
+				case 'I':
+				{
+					listReply = RPL_INVITELIST;
+					endReply = RPL_ENDOFINVITELIST;
+					break;
+				}
+				case 'q':
+				{
+					listReply = RPL_QUIETLIST;
+					endReply = RPL_ENDOFQUIETLIST;
+					break;
+				}
+			}
+			if (numeric == ERR_UNKNOWNMODE)
+			{
+				error = numeric;
+			}
+			else if (!matchesTarget)
+			{
+				return false;
+			}
+			else if (numeric == listReply)
+			{
+				// Without a list mode the reply is a single RPL_CHANNELMODEIS
+				addRow = true;
+				complete = !endReply;
+			}
+			else if (numeric == endReply)
+			{
+				complete = true;
+			}
+			else if (numeric == ERR_NOSUCHCHANNEL || numeric == ERR_NOTONCHANNEL || numeric == ERR_CHANOPRIVSNEEDED)
+			{
+				error = numeric;
+			}
+			else
+			{
+				return false;
+			}
+			break;
+		}
+	}
+	if (addRow)
+	{
+		query.rows.push_back(Data::QueryRow());
+		Data::QueryRow &row = query.rows.back();
+		row.numeric = numeric;
+		if (parameters.size() > 1)
+		{
+			row.fields.assign(parameters.begin() + 1, parameters.end());
+		}
+		if (!trailing.empty())
+		{
+			row.fields.push_back(trailing);
+		}
+	}
+	if (complete || error)
+	{
+		completeQuery(error);
+	}
+	else
+	{
+		query.expiry = std::time(NULL) + QUERY_TIMEOUT;
+	}
+	return true;
 }
 
 void Client::parseBuffer(const std::string &buffer)
 {
+	TRACE_SPAN("Client::parseBuffer");
 	std::string command, delimitedParameters, host, leading = buffer, trailing, user;
 	std::vector<std::string> parameters;
 	std::size_t locationOfTrailing = buffer.find(" :");
@@ -498,97 +2137,175 @@ void Client::parseBuffer(const std::string &buffer)
 			{
 				host = splitLeading.front().substr(locationOfHostname + 1);
 				user = splitLeading.front().substr(1, locationOfHostname - 1);
+				network->updateUserHost(user, host);
+				if (!user.compare(nickname))
+				{
+					ownHost = host;
+				}
 			}
 			else
 			{
 				host = "No hostname";
 				user = splitLeading.front().substr(1);
 			}
-			splitLeading.pop_front();
-		}
-		if (!splitLeading.empty())
-		{
-			command = splitLeading.front();
-			splitLeading.pop_front();
-		}
-		for (std::list<std::string>::iterator i = splitLeading.begin(); i != splitLeading.end(); ++i)
-		{
-			delimitedParameters += *i + " ";
-			parameters.push_back(*i);
-		}
-		boost::algorithm::trim(delimitedParameters);
-	}
-	int numeric = 0;
-	std::istringstream numericStream(command);
-	if ((numericStream >> numeric).eof())
-	{
-		switch (numeric)
-		{
-			case RPL_WELCOME:
+			splitLeading.pop_front();
+		}
+		if (!splitLeading.empty())
+		{
+			command = splitLeading.front();
+			splitLeading.pop_front();
+		}
+		for (std::list<std::string>::iterator i = splitLeading.begin(); i != splitLeading.end(); ++i)
+		{
+			delimitedParameters += *i + " ";
+			parameters.push_back(*i);
+		}
+		boost::algorithm::trim(delimitedParameters);
+	}
+	int numeric = 0;
+	std::istringstream numericStream(command);
+	if ((numericStream >> numeric).eof())
+	{
+		switch (numeric)
+		{
+			case RPL_WELCOME:
+			{
+				Data::Message message;
+				message.array.push_back(Data::OnConnect);
+				message.array.push_back(connectedPort);
+				message.array.push_back(botID);
+				message.buffer.push_back(connectedAddress);
+				core->pushMessage(message);
+				connected = true;
+				for (std::map<std::string, Data::DesiredChannel>::iterator d = desiredChannels.begin(); d != desiredChannels.end(); ++d)
+				{
+					d->second.attempts = 0;
+					d->second.retryTime = 0;
+				}
+				joinChannels();
+				flushOutbox();
+				break;
+			}
+			case RPL_ISUPPORT:
+			{
+				for (std::size_t i = 1; i < parameters.size(); ++i)
+				{
+					std::size_t locationOfValue = parameters.at(i).find('=');
+					if (!parameters.at(i).find('-'))
+					{
+						serverSupport.erase(parameters.at(i).substr(1));
+					}
+					else if (locationOfValue != std::string::npos)
+					{
+						serverSupport[parameters.at(i).substr(0, locationOfValue)] = parameters.at(i).substr(locationOfValue + 1);
+					}
+					else
+					{
+						serverSupport[parameters.at(i)] = "";
+					}
+				}
+				std::map<std::string, std::string>::iterator f = serverSupport.find("PREFIX");
+				if (f != serverSupport.end())
+				{
+					network->setRankPrefixes(f->second);
+				}
+				break;
+			}
+			case RPL_CHANNELMODEIS:
+			{
+				if (parameters.size() >= 3)
+				{
+					ChannelMap::iterator c = network->channels.find(parameters.at(1));
+					if (c != network->channels.end())
+					{
+						std::vector<std::string> modeArguments(parameters.begin() + 2, parameters.end());
+						if (!trailing.empty())
+						{
+							modeArguments.push_back(trailing);
+						}
+						c->second.modes.clear();
+						applyChannelModes(c->second, modeArguments);
+					}
+				}
+				break;
+			}
+			case RPL_CREATIONTIME:
+			{
+				if (parameters.size() >= 3)
+				{
+					ChannelMap::iterator c = network->channels.find(parameters.at(1));
+					if (c != network->channels.end())
+					{
+						c->second.creationTime = std::atoi(parameters.at(2).c_str());
+					}
+				}
+				break;
+			}
+			case RPL_NOTOPIC:
+			case RPL_TOPIC:
+			{
+				if (parameters.size() >= 2)
+				{
+					ChannelMap::iterator c = network->channels.find(parameters.at(1));
+					if (c != network->channels.end())
+					{
+						c->second.topic = numeric == RPL_TOPIC ? trailing : "";
+						if (numeric == RPL_NOTOPIC)
+						{
+							c->second.topicSetter.clear();
+							c->second.topicTime = 0;
+						}
+					}
+				}
+				break;
+			}
+			case RPL_TOPICWHOTIME:
 			{
-					Data::Message message;
-					message.array.push_back(Data::OnConnect);
-					message.array.push_back(connectedPort);
-					message.array.push_back(botID);
-					message.buffer.push_back(connectedAddress);
-					core->messages.push(message);
-					connected = true;
-					break;
+				if (parameters.size() >= 4)
+				{
+					ChannelMap::iterator c = network->channels.find(parameters.at(1));
+					if (c != network->channels.end())
+					{
+						c->second.topicSetter = parameters.at(2);
+						c->second.topicTime = std::atoi(parameters.at(3).c_str());
+					}
+				}
+				break;
 			}
 			case RPL_NAMREPLY:
 			{
 				if (!parameters.empty() && !trailing.empty())
 				{
 					std::string channel = parameters.back();
+					if (sharedNames.find(channel) != sharedNames.end())
+					{
+						break;
+					}
 					std::set<std::string>::iterator f = pendingChannels.find(channel);
 					if (f == pendingChannels.end())
 					{
-						UserMap::iterator u = users.begin();
-						while (u != users.end())
-						{
-							u->second.erase(channel);
-							if (u->second.empty())
-							{
-								users.erase(u++);
-							}
-							else
-							{
-								++u;
-							}
-						}
+						network->removeChannelUsers(channel);
 						pendingChannels.insert(channel);
 					}
 					std::vector<std::string> splitTrailing;
 					boost::algorithm::split(splitTrailing, trailing, boost::algorithm::is_any_of(" "));
 					for (std::vector<std::string>::iterator i = splitTrailing.begin(); i != splitTrailing.end(); ++i)
 					{
-						std::string mode;
-						switch (i->at(0))
-						{
-							case '+':
-							case '%':
-							case '@':
-							case '&':
-							case '!':
-							case '*':
-							case '~':
-							case '.':
-							{
-								mode = i->at(0);
-								break;
-							}
+						int ranks = network->stripRanks(*i);
+						if (i->empty())
+						{
+							continue;
 						}
-						boost::algorithm::trim_if(*i, boost::algorithm::is_any_of("+%@&!*~."));
-						UserMap::iterator f = users.find(*i);
-						if (f != users.end())
+						std::size_t locationOfHostname = i->find('!');
+						if (locationOfHostname != std::string::npos)
 						{
-							f->second.insert(std::make_pair(channel, mode));
+							std::string namesUser = i->substr(0, locationOfHostname);
+							network->addChannelUser(channel, namesUser, ranks);
+							network->updateUserHost(namesUser, i->substr(locationOfHostname + 1));
 						}
 						else
 						{
-							std::map<std::string, std::string> channels;
-							channels.insert(std::make_pair(channel, mode));
-							users.insert(std::make_pair(*i, channels));
+							network->addChannelUser(channel, *i, ranks);
 						}
 					}
 				}
@@ -600,10 +2317,140 @@ void Client::parseBuffer(const std::string &buffer)
 				{
 					std::string channel = parameters.back();
 					pendingChannels.erase(channel);
+					sharedNames.erase(channel);
+					network->pruneUserInfo();
+					if (!outbox.empty())
+					{
+						flushOutbox();
+					}
+				}
+				break;
+			}
+			case RPL_HOSTHIDDEN:
+			{
+				if (parameters.size() >= 2)
+				{
+					std::size_t locationOfHost = ownHost.find('@');
+					if (locationOfHost != std::string::npos)
+					{
+						ownHost = ownHost.substr(0, locationOfHost + 1) + parameters.at(1);
+					}
+					else
+					{
+						ownHost = "~" + username + "@" + parameters.at(1);
+					}
+				}
+				break;
+			}
+			case ERR_CHANNELISFULL:
+			case ERR_INVITEONLYCHAN:
+			case ERR_BANNEDFROMCHAN:
+			case ERR_BADCHANNELKEY:
+			{
+				if (parameters.size() >= 2)
+				{
+					std::map<std::string, Data::DesiredChannel>::iterator d = desiredChannels.find(parameters.at(1));
+					if (d != desiredChannels.end())
+					{
+						// Back off exponentially so a ban or a full channel is not
+						// hammered with JOINs
+						int delay = REJOIN_MAX_DELAY;
+						if (d->second.attempts < 16 && (REJOIN_DELAY << d->second.attempts) < REJOIN_MAX_DELAY)
+						{
+							delay = REJOIN_DELAY << d->second.attempts++;
+						}
+						d->second.retryTime = std::time(NULL) + delay;
+						joinChannels();
+					}
+					// The rejoin has failed, so stop holding messages for the
+					// channel and drop those already held, which would only be
+					// rejected by the server
+					if (rejoinChannels.erase(parameters.at(1)))
+					{
+						std::size_t dropped = 0;
+						std::list<Data::OutboxMessage>::iterator m = outbox.begin();
+						while (m != outbox.end())
+						{
+							if (m->target == parameters.at(1))
+							{
+								m = outbox.erase(m);
+								++dropped;
+							}
+							else
+							{
+								++m;
+							}
+						}
+						if (dropped)
+						{
+							logprintf("*** IRC: Bot %d dropped %u outbox message(s) for %s", botID, static_cast<unsigned>(dropped), parameters.at(1).c_str());
+						}
+						if (!outbox.empty())
+						{
+							flushOutbox();
+						}
+					}
+				}
+				break;
+			}
+			case RPL_WHOREPLY:
+			{
+				if (parameters.size() >= 7)
+				{
+					if (!parameters.at(5).compare(nickname))
+					{
+						ownHost = parameters.at(2) + "@" + parameters.at(3);
+					}
+					UserInfoMap::iterator u = network->userInfo.find(parameters.at(5));
+					if (u != network->userInfo.end())
+					{
+						u->second.ident = parameters.at(2);
+						u->second.host = parameters.at(3);
+						u->second.away = parameters.at(6).find('G') != std::string::npos;
+					}
+					if (pendingWho.find(parameters.at(1)) != pendingWho.end())
+					{
+						return;
+					}
+				}
+				break;
+			}
+			case RPL_WHOSPCRPL:
+			{
+				// Replies to the WHO %tcuhnfa query sent on join, in the order
+				// token, channel, ident, host, nick, flags, account
+				if (parameters.size() >= 8 && !parameters.at(1).compare(WHOX_TOKEN))
+				{
+					if (!parameters.at(5).compare(nickname))
+					{
+						ownHost = parameters.at(3) + "@" + parameters.at(4);
+					}
+					UserInfoMap::iterator u = network->userInfo.find(parameters.at(5));
+					if (u != network->userInfo.end())
+					{
+						u->second.ident = parameters.at(3);
+						u->second.host = parameters.at(4);
+						u->second.away = parameters.at(6).find('G') != std::string::npos;
+						u->second.account = parameters.at(7).compare("0") ? parameters.at(7) : "";
+					}
+					return;
+				}
+				break;
+			}
+			case RPL_ENDOFWHO:
+			{
+				if (parameters.size() >= 2 && pendingWho.erase(parameters.at(1)))
+				{
+					return;
 				}
 				break;
 			}
 		}
+		if (!pendingQueries.empty() && handleQueryReply(numeric, parameters, trailing))
+		{
+			queryReply = true;
+			return;
+		}
 		std::string numericMessage;
 		if (!parameters.empty())
 		{
@@ -623,7 +2470,7 @@ void Client::parseBuffer(const std::string &buffer)
 		message.array.push_back(numeric);
 		message.array.push_back(botID);
 		message.buffer.push_back(numericMessage);
-		core->messages.push(message);
+		core->pushMessage(message);
 	}
 	else
 	{
@@ -642,23 +2489,24 @@ void Client::parseBuffer(const std::string &buffer)
 					{
 						if (user.compare(nickname) != 0)
 						{
-							Data::Message message;
-							message.array.push_back(Data::OnUserNickChange);
-							message.array.push_back(botID);
-							message.buffer.push_back(host);
-							message.buffer.push_back(parameters.back());
-							message.buffer.push_back(user);
-							core->messages.push(message);
+							if (isUserGroupLeader(user))
+							{
+								Data::Message message;
+								message.array.push_back(Data::OnUserNickChange);
+								message.array.push_back(botID);
+								message.buffer.push_back(host);
+								message.buffer.push_back(parameters.back());
+								message.buffer.push_back(user);
+								core->pushMessage(message);
+							}
 						}
 						else
 						{
 							nickname = parameters.back();
 						}
-						UserMap::iterator f = users.find(user);
-						if (f != users.end())
+						if (network->getUserWriter(user) == botID)
 						{
-							users.insert(std::make_pair(parameters.back(), f->second));
-							users.erase(f);
+							network->renameUser(user, parameters.back());
 						}
 					}
 					break;
@@ -667,55 +2515,133 @@ void Client::parseBuffer(const std::string &buffer)
 				{
 					if (!host.empty() && !user.empty())
 					{
-						if (user.compare(nickname) != 0)
+						if (user.compare(nickname) != 0 && isNetSplit(trailing))
+						{
+							// Collect everyone lost in the split into a single event,
+							// and drop them from the member lists in one pass once
+							// the current read has been parsed
+							Data::NetSplit &netSplit = pendingNetSplits[trailing];
+							std::vector<std::string> userChannels = network->getUserChannels(user);
+							netSplit.channels.insert(userChannels.begin(), userChannels.end());
+							if (netSplit.users.empty())
+							{
+								netSplit.host = host;
+							}
+							netSplit.users.insert(user);
+							netSplits[trailing].time = std::time(NULL);
+							netSplits[trailing].users.insert(user);
+							if (network->getUserWriter(user) == botID)
+							{
+								splitUsers.insert(user);
+							}
+							startNetSplitTimer();
+						}
+						else if (user.compare(nickname) != 0)
 						{
 							if (trailing.empty())
 							{
 								trailing = "No reason";
 							}
-							Data::Message message;
-							message.array.push_back(Data::OnUserDisconnect);
-							message.array.push_back(botID);
-							message.buffer.push_back(trailing);
-							message.buffer.push_back(host);
-							message.buffer.push_back(user);
-							core->messages.push(message);
-							users.erase(user);
+							if (isUserGroupLeader(user))
+							{
+								Data::Message message;
+								message.array.push_back(Data::OnUserDisconnect);
+								message.array.push_back(botID);
+								message.buffer.push_back(trailing);
+								message.buffer.push_back(host);
+								message.buffer.push_back(user);
+								core->pushMessage(message);
+							}
+							if (network->getUserWriter(user) == botID)
+							{
+								network->removeUser(user);
+							}
 						}
 					}
 					break;
 				}
 				case Join:
 				{
-					if (!host.empty() && !trailing.empty() && !user.empty())
+					// With extended-join the channel is the first parameter and is
+					// followed by the account name, and the trailing holds the real name
+					std::string channel = parameters.empty() ? trailing : parameters.at(0);
+					if (!host.empty() && !channel.empty() && !user.empty())
 					{
+						if (splitUsers.find(user) != splitUsers.end())
+						{
+							network->removeUsers(splitUsers);
+							splitUsers.clear();
+						}
+						bool netJoin = false, report = true;
 						Data::Message message;
 						if (!user.compare(nickname))
 						{
 							message.array.push_back(Data::OnJoinChannel);
 							message.array.push_back(botID);
-							message.buffer.push_back(trailing);
+							message.buffer.push_back(channel);
+							std::map<std::string, Data::DesiredChannel>::iterator d = desiredChannels.find(channel);
+							if (d != desiredChannels.end())
+							{
+								d->second.attempts = 0;
+							}
+							attachNetwork();
+							joinedChannels.insert(channel);
+							rejoinChannels.erase(channel);
+							if (network->addChannelReference(channel, botID))
+							{
+								// Rejoining many channels at once would otherwise send
+								// a MODE and a WHO for each in one burst
+								pendingChannelQueries.push_back(channel);
+								flushOutbox();
+							}
+							else
+							{
+								// Another bot on this network is already in the channel
+								// and keeps its state, so skip the queries and its NAMES
+								sharedNames.insert(channel);
+							}
 						}
 						else
 						{
-							message.array.push_back(Data::OnUserJoinChannel);
-							message.array.push_back(botID);
-							message.buffer.push_back(host);
-							message.buffer.push_back(user);
-							message.buffer.push_back(trailing);
+							for (std::map<std::string, Data::NetSplit>::iterator s = netSplits.begin(); s != netSplits.end(); ++s)
+							{
+								if (s->second.users.find(user) != s->second.users.end())
+								{
+									Data::NetSplit &pendingNetJoin = pendingNetJoins[s->first];
+									pendingNetJoin.channels.insert(channel);
+									pendingNetJoin.users.insert(user);
+									startNetSplitTimer();
+									netJoin = true;
+									break;
+								}
+							}
+							report = !netJoin && isGroupLeader(channel);
+							if (report)
+							{
+								message.array.push_back(Data::OnUserJoinChannel);
+								message.array.push_back(botID);
+								message.buffer.push_back(host);
+								message.buffer.push_back(user);
+								message.buffer.push_back(channel);
+							}
 						}
-						UserMap::iterator f = users.find(user);
-						if (f != users.end())
+						if (network->getChannelWriter(channel) == botID)
 						{
-							f->second.insert(std::make_pair(trailing, ""));
+							network->addChannelUser(channel, user, 0);
+							network->updateUserHost(user, host);
+							if (parameters.size() >= 2)
+							{
+								UserInfoMap::iterator u = network->userInfo.find(user);
+								if (u != network->userInfo.end())
+								{
+									u->second.account = parameters.at(1).compare("*") ? parameters.at(1) : "";
+								}
+							}
 						}
-						else
+						if (report)
 						{
-							std::map<std::string, std::string> channels;
-							channels.insert(std::make_pair(trailing, ""));
-							users.insert(std::make_pair(user, channels));
+							core->pushMessage(message);
 						}
-						core->messages.push(message);
 					}
 					break;
 				}
@@ -727,6 +2653,7 @@ void Client::parseBuffer(const std::string &buffer)
 						{
 							trailing = "No reason";
 						}
+						bool report = true;
 						Data::Message message;
 						if (!user.compare(nickname))
 						{
@@ -734,19 +2661,12 @@ void Client::parseBuffer(const std::string &buffer)
 							message.array.push_back(botID);
 							message.buffer.push_back(trailing);
 							message.buffer.push_back(parameters.back());
-							UserMap::iterator u = users.begin();
-							while (u != users.end())
+							desiredChannels.erase(parameters.back());
+							if (network->getChannelWriter(parameters.back()) == botID)
 							{
-								u->second.erase(parameters.back());
-								if (u->second.empty())
-								{
-									users.erase(u++);
-								}
-								else
-								{
-									++u;
-								}
+								network->removeChannelUser(parameters.back(), nickname);
 							}
+							removeChannel(parameters.back());
 						}
 						else
 						{
@@ -756,17 +2676,16 @@ void Client::parseBuffer(const std::string &buffer)
 							message.buffer.push_back(host);
 							message.buffer.push_back(user);
 							message.buffer.push_back(parameters.back());
-							UserMap::iterator f = users.find(user);
-							if (f != users.end())
+							report = isGroupLeader(parameters.back());
+							if (network->getChannelWriter(parameters.back()) == botID)
 							{
-								f->second.erase(parameters.back());
-								if (f->second.empty())
-								{
-									users.erase(f);
-								}
+								network->removeChannelUser(parameters.back(), user);
 							}
 						}
-						core->messages.push(message);
+						if (report)
+						{
+							core->pushMessage(message);
+						}
 					}
 					break;
 				}
@@ -774,11 +2693,18 @@ void Client::parseBuffer(const std::string &buffer)
 				{
 					if (!host.empty() && !parameters.empty() && !user.empty())
 					{
+						ChannelMap::iterator c = network->channels.find(parameters.back());
+						if (c != network->channels.end() && network->getChannelWriter(parameters.back()) == botID)
+						{
+							c->second.topic = trailing;
+							c->second.topicSetter = user;
+							c->second.topicTime = static_cast<int>(std::time(NULL));
+						}
 						if (trailing.empty())
 						{
 							trailing = "No topic";
 						}
-						if (user.compare(nickname) != 0)
+						if (user.compare(nickname) != 0 && isGroupLeader(parameters.back()))
 						{
 							Data::Message message;
 							message.array.push_back(Data::OnUserSetChannelTopic);
@@ -787,7 +2713,7 @@ void Client::parseBuffer(const std::string &buffer)
 							message.buffer.push_back(host);
 							message.buffer.push_back(user);
 							message.buffer.push_back(parameters.back());
-							core->messages.push(message);
+							core->pushMessage(message);
 						}
 					}
 					break;
@@ -802,7 +2728,7 @@ void Client::parseBuffer(const std::string &buffer)
 						message.buffer.push_back(host);
 						message.buffer.push_back(user);
 						message.buffer.push_back(trailing);
-						core->messages.push(message);
+						core->pushMessage(message);
 					}
 					break;
 				}
@@ -814,6 +2740,7 @@ void Client::parseBuffer(const std::string &buffer)
 						{
 							trailing = "No reason";
 						}
+						bool report = true;
 						Data::Message message;
 						if (!parameters.at(1).compare(nickname))
 						{
@@ -823,19 +2750,11 @@ void Client::parseBuffer(const std::string &buffer)
 							message.buffer.push_back(host);
 							message.buffer.push_back(user);
 							message.buffer.push_back(parameters.at(0));
-							UserMap::iterator u = users.begin();
-							while (u != users.end())
+							if (network->getChannelWriter(parameters.at(0)) == botID)
 							{
-								u->second.erase(parameters.at(0));
-								if (u->second.empty())
-								{
-									users.erase(u++);
-								}
-								else
-								{
-									++u;
-								}
+								network->removeChannelUser(parameters.at(0), nickname);
 							}
+							removeChannel(parameters.at(0));
 						}
 						else
 						{
@@ -846,17 +2765,16 @@ void Client::parseBuffer(const std::string &buffer)
 							message.buffer.push_back(user);
 							message.buffer.push_back(parameters.at(1));
 							message.buffer.push_back(parameters.at(0));
-							UserMap::iterator f = users.find(parameters.at(1));
-							if (f != users.end())
+							report = isGroupLeader(parameters.at(0));
+							if (network->getChannelWriter(parameters.at(0)) == botID)
 							{
-								f->second.erase(parameters.at(0));
-								if (f->second.empty())
-								{
-									users.erase(f);
-								}
+								network->removeChannelUser(parameters.at(0), parameters.at(1));
 							}
 						}
-						core->messages.push(message);
+						if (report)
+						{
+							core->pushMessage(message);
+						}
 					}
 					break;
 				}
@@ -868,7 +2786,17 @@ void Client::parseBuffer(const std::string &buffer)
 						std::size_t result = delimitedParameters.find_first_of(' ');
 						if (result != std::string::npos)
 						{
-							if (user.compare(nickname) != 0)
+							ChannelMap::iterator c = network->channels.find(parameters.at(0));
+							if (c != network->channels.end() && network->getChannelWriter(parameters.at(0)) == botID)
+							{
+								std::vector<std::string> modeArguments(parameters.begin() + 1, parameters.end());
+								if (!trailing.empty())
+								{
+									modeArguments.push_back(trailing);
+								}
+								applyChannelModes(c->second, modeArguments);
+							}
+							if (user.compare(nickname) != 0 && isGroupLeader(parameters.at(0)))
 							{
 								Data::Message message;
 								message.array.push_back(Data::OnUserSetChannelMode);
@@ -877,11 +2805,7 @@ void Client::parseBuffer(const std::string &buffer)
 								message.buffer.push_back(host);
 								message.buffer.push_back(user);
 								message.buffer.push_back(parameters.at(0));
-								core->messages.push(message);
-							}
-							if (parameters.at(1).find_first_of("vhoauq") != std::string::npos)
-							{
-								sendAsync(boost::str(boost::format("NAMES %1%\r\n") % parameters.at(0)));
+								core->pushMessage(message);
 							}
 						}
 					}
@@ -891,6 +2815,10 @@ void Client::parseBuffer(const std::string &buffer)
 				{
 					if (!host.empty() && !parameters.empty() && !trailing.empty() && !user.empty())
 					{
+						if (!isGroupLeader(parameters.back()))
+						{
+							return;
+						}
 						if (trailing.at(0) == '\001')
 						{
 							boost::algorithm::erase_all(trailing, "\001");
@@ -900,32 +2828,20 @@ void Client::parseBuffer(const std::string &buffer)
 							message.buffer.push_back(trailing);
 							message.buffer.push_back(host);
 							message.buffer.push_back(user);
-							core->messages.push(message);
+							core->pushMessage(message);
 						}
 						else
 						{
-							if (parameters.back().at(0) == '#' || parameters.back().at(0) == '&')
-							{
-								GroupMap::iterator f = core->groups.find(groupID);
-								if (f != core->groups.end())
-								{
-									std::map<int, bool>::iterator g = f->second.begin();
-									if (g->first != botID)
-									{
-										return;
-									}
-								}
-							}
 							if (user.compare(nickname) != 0)
 							{
 								Data::Message message;
 								message.array.push_back(Data::OnUserSay);
 								message.array.push_back(botID);
-								message.buffer.push_back(trailing);
+								message.buffer.push_back(convertFormatting(trailing));
 								message.buffer.push_back(host);
 								message.buffer.push_back(user);
 								message.buffer.push_back(parameters.back());
-								core->messages.push(message);
+								core->pushMessage(message);
 							}
 						}
 					}
@@ -935,6 +2851,10 @@ void Client::parseBuffer(const std::string &buffer)
 				{
 					if (!host.empty() && !parameters.empty() && !trailing.empty() && !user.empty())
 					{
+						if (!isGroupLeader(parameters.back()))
+						{
+							return;
+						}
 						if (trailing.at(0) == '\001')
 						{
 							boost::algorithm::erase_all(trailing, "\001");
@@ -944,7 +2864,7 @@ void Client::parseBuffer(const std::string &buffer)
 							message.buffer.push_back(trailing);
 							message.buffer.push_back(host);
 							message.buffer.push_back(user);
-							core->messages.push(message);
+							core->pushMessage(message);
 						}
 						else
 						{
@@ -953,11 +2873,11 @@ void Client::parseBuffer(const std::string &buffer)
 								Data::Message message;
 								message.array.push_back(Data::OnUserNotice);
 								message.array.push_back(botID);
-								message.buffer.push_back(trailing);
+								message.buffer.push_back(convertFormatting(trailing));
 								message.buffer.push_back(host);
 								message.buffer.push_back(user);
 								message.buffer.push_back(parameters.back());
-								core->messages.push(message);
+								core->pushMessage(message);
 							}
 						}
 					}
@@ -971,6 +2891,104 @@ void Client::parseBuffer(const std::string &buffer)
 					sendAsync(sendBuffer);
 					break;
 				}
+				case Cap:
+				{
+					if (parameters.size() >= 2)
+					{
+						if (!parameters.at(1).compare("LS"))
+						{
+							offeredCapabilities += " " + trailing;
+							if (parameters.size() >= 3 && !parameters.at(2).compare("*"))
+							{
+								break;
+							}
+							static const char *wantedCapabilities[] =
+							{
+								"account-notify",
+								"away-notify",
+								"extended-join",
+								"multi-prefix",
+								"userhost-in-names"
+							};
+							std::vector<std::string> splitCapabilities;
+							boost::algorithm::split(splitCapabilities, offeredCapabilities, boost::algorithm::is_any_of(" "));
+							std::string requestedCapabilities;
+							for (std::vector<std::string>::iterator i = splitCapabilities.begin(); i != splitCapabilities.end(); ++i)
+							{
+								std::string capability = i->substr(0, i->find('='));
+								for (std::size_t j = 0; j < sizeof(wantedCapabilities) / sizeof(const char*); ++j)
+								{
+									if (!capability.compare(wantedCapabilities[j]))
+									{
+										requestedCapabilities += capability + " ";
+									}
+								}
+							}
+							offeredCapabilities.clear();
+							if (requestedCapabilities.empty())
+							{
+								Command(*this, "CAP").parameter("END").send();
+							}
+							else
+							{
+								requestedCapabilities.resize(requestedCapabilities.length() - 1);
+								Command(*this, "CAP").parameter("REQ").trailing(requestedCapabilities).send();
+							}
+						}
+						else if (!parameters.at(1).compare("ACK"))
+						{
+							std::vector<std::string> splitCapabilities;
+							boost::algorithm::split(splitCapabilities, trailing, boost::algorithm::is_any_of(" "));
+							for (std::vector<std::string>::iterator i = splitCapabilities.begin(); i != splitCapabilities.end(); ++i)
+							{
+								if (!i->empty() && i->at(0) == '-')
+								{
+									capabilities.erase(i->substr(1));
+								}
+								else if (!i->empty())
+								{
+									capabilities.insert(*i);
+								}
+							}
+							if (!connected)
+							{
+								Command(*this, "CAP").parameter("END").send();
+							}
+						}
+						else if (!parameters.at(1).compare("NAK"))
+						{
+							if (!connected)
+							{
+								Command(*this, "CAP").parameter("END").send();
+							}
+						}
+					}
+					break;
+				}
+				case Account:
+				{
+					if (!host.empty() && !parameters.empty() && !user.empty())
+					{
+						UserInfoMap::iterator u = network->userInfo.find(user);
+						if (u != network->userInfo.end() && network->getUserWriter(user) == botID)
+						{
+							u->second.account = parameters.at(0).compare("*") ? parameters.at(0) : "";
+						}
+					}
+					break;
+				}
+				case Away:
+				{
+					if (!host.empty() && !user.empty())
+					{
+						UserInfoMap::iterator u = network->userInfo.find(user);
+						if (u != network->userInfo.end() && network->getUserWriter(user) == botID)
+						{
+							u->second.away = !trailing.empty();
+						}
+					}
+					break;
+				}
 			}
 		}
 	}
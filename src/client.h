@@ -17,23 +17,51 @@
 #ifndef CLIENT_H
 #define CLIENT_H
 
+#define KEEPALIVE_INTERVAL (30)
+#define NETSPLIT_DELAY (1000)
+#define NETSPLIT_EXPIRY (3600)
+#define OUTBOX_INTERVAL (2000)
+#define OUTBOX_WINDOW (10000)
+#define QUERY_TIMEOUT (30)
+#define RELAY_SEPARATOR " | "
+#define REJOIN_DELAY (15)
+#define REJOIN_MAX_DELAY (300)
+#define SCHEDULE_MIN_INTERVAL (1000)
+#define WHOX_TOKEN "31"
+
+#include "capture.h"
 #include "common.h"
+#include "network.h"
 
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
 #include <boost/enable_shared_from_this.hpp>
 
+#include <deque>
+#include <list>
 #include <map>
 #include <string>
-#include <queue>
 #include <set>
+#include <vector>
 
 class Client : public boost::enable_shared_from_this<Client>
 {
+	friend class Command;
 public:
 	Client(boost::asio::io_service &io_service);
 
+	void cancelQueries(int scriptID);
+	bool cancelScheduledMessage(int scheduleID);
+	void flushRelayBuffers();
+	bool joinChannel(const std::string &channel, const std::string &key);
+	void partChannel(const std::string &channel);
+	void processData(const char *data, std::size_t length);
 	void sendAsync(const std::string &buffer);
+	bool sendMessage(const char *command, const char *target, const char *text);
+	bool sendMessage(const char *command, const std::vector<std::string> &targets, const char *text);
+	bool sendQuery(const Data::Query &query);
+	void resumeRead();
+	int scheduleMessage(const std::string &target, const std::string &text, int delay, int interval);
 	bool socketOpen();
 	void startAsync();
 	void stopAsync();
@@ -44,6 +72,15 @@ public:
 	int receiveTimeout;
 	bool respawn;
 
+	int charset;
+	int formatting;
+
+	std::size_t outboxSize;
+	int outboxTTL;
+
+	std::size_t relaySize;
+	int relayWindow;
+
 	bool connected;
 	int botID;
 	int groupID;
@@ -60,7 +97,8 @@ public:
 
 	std::string serverPassword;
 
-	UserMap users;
+	Capture capture;
+	SharedNetwork network;
 private:
 	void handleConnect(const boost::system::error_code &error, boost::asio::ip::tcp::resolver::iterator iterator);
 	void handleHandshake(const boost::system::error_code &error);
@@ -70,15 +108,62 @@ private:
 
 	void handleConnectTimer(const boost::system::error_code &error, boost::asio::ip::tcp::resolver::iterator iterator);
 	void handleConnectTimeoutTimer(const boost::system::error_code &error);
+	void handleKeepAliveTimer(const boost::system::error_code &error);
+	void handleNetSplitTimer(const boost::system::error_code &error);
+	void handleOutboxTimer(const boost::system::error_code &error);
+	void handleQueryTimer(const boost::system::error_code &error);
+	void handleRejoinTimer(const boost::system::error_code &error);
 	void handleReceiveTimeoutTimer(const boost::system::error_code &error);
+	void handleRelayTimer(const boost::system::error_code &error);
 	void handleResolveTimer(const boost::system::error_code &error);
+	void handleScheduleTimer(const boost::system::error_code &error);
+	void resetOutboxTimer();
+	void resetRelayTimer();
+	void resetScheduleTimer();
 
+	void pauseRead();
 	void startRead();
 
 	void startConnectTimer(boost::asio::ip::tcp::resolver::iterator iterator);
 	void startConnectTimeoutTimer();
+	void startKeepAliveTimer();
+	void startNetSplitTimer();
+	void startQueryTimer();
 	void startReceiveTimeoutTimer();
+	void startRelayTimer();
 	void startResolveTimer();
+	void startScheduleTimer();
+
+	void flushAsync();
+	void flushOutbox();
+	void joinChannels();
+	void handleFlush();
+	bool isTargetReady(const std::string &target);
+	std::size_t getMessageBudget(std::size_t prefixLength);
+	bool queueMessage(const char *command, const char *target, const char *text);
+	bool relayMessage(const char *command, const char *target, const char *text);
+	void sendRegistration();
+	void startWrite();
+	bool writeMessage(const char *command, const char *target, const char *text);
+
+	std::string convertFormatting(const std::string &text);
+
+	void attachNetwork();
+	void detachNetwork();
+	void removeChannel(const std::string &channel);
+
+	bool isGroupLeader(const std::string &channel);
+	bool isGroupLeader(const std::vector<std::string> &eventChannels);
+	bool isUserGroupLeader(const std::string &user);
+	bool isNetSplit(const std::string &reason);
+	void pushNetSplits();
+
+	int getChannelModeType(char mode);
+	std::size_t getTargetLimit(const char *command);
+	void applyChannelModes(Data::Channel &channel, const std::vector<std::string> &arguments);
+
+	void completeQuery(int error);
+	bool handleQueryReply(int numeric, const std::vector<std::string> &parameters, const std::string &trailing);
 
 	void parseBuffer(const std::string &buffer);
 
@@ -94,14 +179,61 @@ private:
 		Mode,
 		Privmsg,
 		Notice,
-		Ping
+		Ping,
+		Cap,
+		Account,
+		Away
+	};
+
+	enum ChannelModeTypes
+	{
+		ListMode,
+		ParameterMode,
+		SetParameterMode,
+		FlagMode,
+		PrefixMode
 	};
 
 	enum Replies
 	{
 		RPL_WELCOME = 1,
+		RPL_ISUPPORT = 5,
+		RPL_TRYAGAIN = 263,
+		RPL_ENDOFWHOIS = 318,
+		RPL_LISTSTART = 321,
+		RPL_LIST = 322,
+		RPL_LISTEND = 323,
+		RPL_CHANNELMODEIS = 324,
+		RPL_CREATIONTIME = 329,
+		RPL_NOTOPIC = 331,
+		RPL_TOPIC = 332,
+		RPL_TOPICWHOTIME = 333,
+		RPL_INVITELIST = 346,
+		RPL_ENDOFINVITELIST = 347,
+		RPL_EXCEPTLIST = 348,
+		RPL_ENDOFEXCEPTLIST = 349,
+		RPL_ENDOFWHO = 315,
+		RPL_WHOREPLY = 352,
+		RPL_WHOSPCRPL = 354,
 		RPL_NAMREPLY = 353,
-		RPL_ENDOFNAMES = 366
+		RPL_ENDOFNAMES = 366,
+		RPL_BANLIST = 367,
+		RPL_ENDOFBANLIST = 368,
+		RPL_HOSTHIDDEN = 396,
+		ERR_NOSUCHNICK = 401,
+		ERR_NOSUCHSERVER = 402,
+		ERR_NOSUCHCHANNEL = 403,
+		ERR_TOOMANYMATCHES = 416,
+		ERR_NONICKNAMEGIVEN = 431,
+		ERR_NOTONCHANNEL = 442,
+		ERR_CHANNELISFULL = 471,
+		ERR_UNKNOWNMODE = 472,
+		ERR_INVITEONLYCHAN = 473,
+		ERR_BANNEDFROMCHAN = 474,
+		ERR_BADCHANNELKEY = 475,
+		ERR_CHANOPRIVSNEEDED = 482,
+		RPL_QUIETLIST = 728,
+		RPL_ENDOFQUIETLIST = 729
 	};
 
 	boost::asio::ip::tcp::socket clientSocket;
@@ -111,19 +243,53 @@ private:
 
 	boost::asio::deadline_timer connectTimer;
 	boost::asio::deadline_timer connectTimeoutTimer;
+	boost::asio::deadline_timer keepAliveTimer;
+	boost::asio::deadline_timer netSplitTimer;
+	boost::asio::deadline_timer outboxTimer;
+	boost::asio::deadline_timer queryTimer;
 	boost::asio::deadline_timer receiveTimeoutTimer;
+	boost::asio::deadline_timer relayTimer;
+	boost::asio::deadline_timer rejoinTimer;
 	boost::asio::deadline_timer resolveTimer;
+	boost::asio::deadline_timer scheduleTimer;
 
 	std::string connectedAddress;
 	unsigned short connectedPort;
 
 	int currentConnectAttempts;
+	std::map<std::string, Data::DesiredChannel> desiredChannels;
+	std::set<std::string> joinedChannels;
+	std::set<std::string> capabilities;
+	std::string offeredCapabilities;
+	std::string networkName;
+	std::map<std::string, Data::NetSplit> netSplits;
+	std::list<Data::OutboxMessage> outbox;
+	boost::posix_time::ptime outboxPenalty;
+	std::string ownHost;
 	std::set<std::string> pendingChannels;
-	std::queue<std::string> pendingMessages;
+	std::map<std::string, Data::NetSplit> pendingNetJoins;
+	std::map<std::string, Data::NetSplit> pendingNetSplits;
+	std::deque<std::string> pendingChannelQueries;
+	std::set<std::string> pendingWho;
+	std::deque<Data::Query> pendingQueries;
+	std::set<std::string> rejoinChannels;
+	std::map<std::pair<std::string, std::string>, Data::RelayBuffer> relayBuffers;
+	int lastScheduleID;
+	std::map<int, Data::ScheduledMessage> scheduledMessages;
+	std::set<std::string> sharedNames;
+	std::set<std::string> splitUsers;
 	char receivedData[MAX_BUFFER];
+	std::string outboundBuffer;
+	std::string partialLine;
 	std::string sentData;
+	std::string transcodedMessage;
 	std::map<std::string, int> serverCommands;
+	std::map<std::string, std::string> serverSupport;
 	bool timedOut;
+	bool closing;
+	bool flushPending;
+	bool queryReply;
+	bool readPaused;
 	bool writeInProgress;
 };
 
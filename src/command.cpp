@@ -0,0 +1,120 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "command.h"
+
+#include "client.h"
+#include "main.h"
+#include "text.h"
+
+#include <cstring>
+#include <string>
+
+Command::Command(Client &client, const char *verb) : client(client), sent(false), valid(true), verb(verb)
+{
+	start = client.outboundBuffer.length();
+	append(verb, std::strlen(verb));
+}
+
+Command::Command(Client &client, const char *verb, std::size_t length) : client(client), sent(false), valid(true), verb(verb)
+{
+	start = client.outboundBuffer.length();
+	append(verb, length);
+}
+
+Command::~Command()
+{
+	if (!sent)
+	{
+		client.outboundBuffer.resize(start);
+	}
+}
+
+Command &Command::append(const char *value)
+{
+	return append(value, std::strlen(value));
+}
+
+Command &Command::append(const char *value, std::size_t length, bool encoded)
+{
+	if (!isValid(value, length))
+	{
+		valid = false;
+	}
+	if (valid)
+	{
+		Text::appendUTF8(client.outboundBuffer, value, length, encoded ? static_cast<int>(Text::UTF8) : client.charset);
+	}
+	return *this;
+}
+
+Command &Command::parameter(const char *value)
+{
+	client.outboundBuffer += ' ';
+	return append(value, std::strlen(value));
+}
+
+Command &Command::parameter(const std::string &value)
+{
+	client.outboundBuffer += ' ';
+	return append(value.data(), value.length());
+}
+
+Command &Command::trailing(const char *value)
+{
+	client.outboundBuffer.append(" :");
+	return append(value, std::strlen(value));
+}
+
+Command &Command::trailing(const std::string &value)
+{
+	client.outboundBuffer.append(" :");
+	return append(value.data(), value.length());
+}
+
+std::size_t Command::length() const
+{
+	return client.outboundBuffer.length() - start;
+}
+
+bool Command::send(bool flush)
+{
+	if (!valid)
+	{
+		client.outboundBuffer.resize(start);
+		logprintf("*** IRC: Discarded %.16s command containing CR, LF, or NUL", verb);
+		return false;
+	}
+	client.outboundBuffer.append("\r\n");
+	sent = true;
+	if (flush)
+	{
+		client.flushAsync();
+	}
+	return true;
+}
+
+bool Command::isValid(const char *value, std::size_t length)
+{
+	for (std::size_t i = 0; i < length; ++i)
+	{
+		if (value[i] == '\r' || value[i] == '\n' || value[i] == '\0')
+		{
+			return false;
+		}
+	}
+	return true;
+}
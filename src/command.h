@@ -0,0 +1,55 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef COMMAND_H
+#define COMMAND_H
+
+#include <cstddef>
+#include <string>
+
+class Client;
+
+// Builds one IRC line directly in a client's outbound buffer. Parameters are
+// transcoded to UTF-8 as they are appended, and a line with CR, LF, or NUL in
+// any part of it is discarded instead of sent.
+
+class Command
+{
+public:
+	Command(Client &client, const char *verb);
+	Command(Client &client, const char *verb, std::size_t length);
+	~Command();
+
+	Command &append(const char *value);
+	Command &append(const char *value, std::size_t length, bool encoded = false);
+	Command &parameter(const char *value);
+	Command &parameter(const std::string &value);
+	Command &trailing(const char *value);
+	Command &trailing(const std::string &value);
+
+	std::size_t length() const;
+	bool send(bool flush = true);
+
+	static bool isValid(const char *value, std::size_t length);
+private:
+	Client &client;
+	std::size_t start;
+	bool sent;
+	bool valid;
+	const char *verb;
+};
+
+#endif
@@ -18,18 +18,27 @@
 #define COMMON_H
 
 #define MAX_BUFFER (4096)
+#define MAX_HOST_LENGTH (63)
+#define MAX_LINE_LENGTH (512)
+
+#include "data.h"
 
 #include <boost/scoped_ptr.hpp>
 #include <boost/shared_ptr.hpp>
 
 #include <map>
 #include <string>
+#include <vector>
 
 class Client;
+class Network;
 
 typedef boost::shared_ptr<Client> SharedClient;
+typedef boost::shared_ptr<Network> SharedNetwork;
 
+typedef std::map<std::string, Data::Channel> ChannelMap;
 typedef std::map<int, std::map<int, bool> > GroupMap;
-typedef std::map<std::string, std::map<std::string, std::string> > UserMap;
+typedef std::map<std::string, Data::User> UserInfoMap;
+typedef std::map<std::string, std::vector<Data::Membership> > UserMap;
 
 #endif
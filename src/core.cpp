@@ -16,14 +16,189 @@
 
 #include "core.h"
 
+#include "client.h"
+#include "trace.h"
+
 #include <boost/asio.hpp>
+#include <boost/bind.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
 boost::scoped_ptr<Core> core;
 
-Core::Core() : work(io_service)
+namespace
+{
+	int getEventClass(int callback)
+	{
+		switch (callback)
+		{
+			case Data::OnConnect:
+			case Data::OnDisconnect:
+			case Data::OnConnectAttempt:
+			case Data::OnConnectAttemptFail:
+			case Data::OnJoinChannel:
+			case Data::OnLeaveChannel:
+			case Data::OnInvitedToChannel:
+			case Data::OnKickedFromChannel:
+			case Data::OnQueryResult:
+			{
+				return Data::LifecycleEvents;
+			}
+			case Data::OnUserSay:
+			case Data::OnUserNotice:
+			case Data::OnUserRequestCTCP:
+			case Data::OnUserReplyCTCP:
+			{
+				return Data::ChatEvents;
+			}
+			case Data::OnReceiveNumeric:
+			case Data::OnReceiveRaw:
+			{
+				return Data::RawEvents;
+			}
+		}
+		return Data::MembershipEvents;
+	}
+
+	std::size_t getMessageSize(const Data::Message &message)
+	{
+		std::size_t size = sizeof(Data::Message) + message.array.size() * sizeof(int);
+		for (std::vector<std::string>::const_iterator b = message.buffer.begin(); b != message.buffer.end(); ++b)
+		{
+			size += sizeof(std::string) + b->length();
+		}
+		return size;
+	}
+}
+
+Core::Core() : work(io_service), queuedMessages(0), highWatermark(0), lowWatermark(0), readPauses(0), lastQueryID(0)
 {
+	eventQueues[Data::LifecycleEvents].weight = 8;
+	eventQueues[Data::ChatEvents].weight = 4;
+	eventQueues[Data::MembershipEvents].weight = 2;
+	eventQueues[Data::RawEvents].weight = 1;
 	boost::system::error_code error;
-	boost::thread thread(boost::bind(&boost::asio::io_service::run, &io_service, error));
+	thread.reset(new boost::thread(boost::bind(&boost::asio::io_service::run, &io_service, error)));
+}
+
+void Core::stop()
+{
+	io_service.stop();
+	thread->join();
+}
+
+bool Core::isQueueFull()
+{
+	return highWatermark && queuedMessages >= highWatermark;
+}
+
+bool Core::popMessage(Data::Message &message)
+{
+	// Smooth weighted round-robin: every class with events waiting earns its
+	// weight in credit, the class with the most credit is served and pays
+	// back the total, so each class gets its share without long bursts
+	int selected = -1, totalWeight = 0;
+	for (int i = 0; i < EVENT_CLASSES; ++i)
+	{
+		if (!eventQueues[i].messages.empty())
+		{
+			eventQueues[i].credit += eventQueues[i].weight;
+			totalWeight += eventQueues[i].weight;
+			if (selected < 0 || eventQueues[i].credit > eventQueues[selected].credit)
+			{
+				selected = i;
+			}
+		}
+	}
+	if (selected < 0)
+	{
+		return false;
+	}
+	Data::EventQueue &eventQueue = eventQueues[selected];
+	eventQueue.credit -= totalWeight;
+	eventQueue.bytes -= getMessageSize(eventQueue.messages.front());
+	std::swap(message, eventQueue.messages.front());
+	eventQueue.messages.pop_front();
+	--queuedMessages;
+	return true;
+}
+
+void Core::pushMessage(const Data::Message &message)
+{
+	TRACE_SPAN("Core::pushMessage");
+	Data::EventQueue &eventQueue = eventQueues[getEventClass(message.array.at(0))];
+	std::size_t size = getMessageSize(message);
+	if (eventQueue.policy == Data::DropNewest)
+	{
+		if ((eventQueue.maxMessages && eventQueue.messages.size() >= eventQueue.maxMessages) || (eventQueue.maxBytes && eventQueue.bytes + size > eventQueue.maxBytes))
+		{
+			if (message.array.at(0) == Data::OnQueryResult)
+			{
+				queryResults.erase(message.array.at(2));
+			}
+			++eventQueue.dropped;
+			return;
+		}
+	}
+	else
+	{
+		while (!eventQueue.messages.empty() && ((eventQueue.maxMessages && eventQueue.messages.size() >= eventQueue.maxMessages) || (eventQueue.maxBytes && eventQueue.bytes + size > eventQueue.maxBytes)))
+		{
+			eventQueue.bytes -= getMessageSize(eventQueue.messages.front());
+			if (eventQueue.messages.front().array.at(0) == Data::OnQueryResult)
+			{
+				queryResults.erase(eventQueue.messages.front().array.at(2));
+			}
+			eventQueue.messages.pop_front();
+			--queuedMessages;
+			++eventQueue.dropped;
+		}
+	}
+	eventQueue.messages.push_back(message);
+	eventQueue.bytes += size;
+	++queuedMessages;
+#ifdef IRC_TRACE
+	eventQueue.messages.back().timestamp = Trace::now();
+#endif
+}
+
+void Core::removeQueries(int scriptID)
+{
+	std::map<int, Data::Query>::iterator q = queryResults.begin();
+	while (q != queryResults.end())
+	{
+		if (q->second.scriptID == scriptID)
+		{
+			queryResults.erase(q++);
+		}
+		else
+		{
+			++q;
+		}
+	}
+	for (std::map<int, SharedClient>::iterator c = clients.begin(); c != clients.end(); ++c)
+	{
+		c->second->cancelQueries(scriptID);
+	}
+}
+
+void Core::resumeReads()
+{
+	// Reads restart on the network thread, since that is where every other
+	// operation on the sockets happens
+	for (std::set<int>::iterator p = pausedClients.begin(); p != pausedClients.end(); ++p)
+	{
+		std::map<int, SharedClient>::iterator c = clients.find(*p);
+		if (c != clients.end())
+		{
+			io_service.post(boost::bind(&Client::resumeRead, c->second));
+		}
+	}
+	pausedClients.clear();
 }
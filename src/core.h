@@ -17,8 +17,12 @@
 #ifndef CORE_H
 #define CORE_H
 
+#define EVENT_CLASSES (4)
+
 #include "common.h"
 #include "data.h"
+#include "profiler.h"
+#include "router.h"
 
 #include <boost/asio.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -27,22 +31,43 @@
 #include <sdk/plugin.h>
 
 #include <map>
-#include <queue>
 #include <set>
+#include <string>
 
 class Core
 {
 public:
 	Core();
 
+	bool isQueueFull();
+	bool popMessage(Data::Message &message);
+	void pushMessage(const Data::Message &message);
+	void removeQueries(int scriptID);
+	void resumeReads();
+	void stop();
+
 	boost::mutex mutex;
 	boost::asio::io_service io_service;
 	boost::asio::io_service::work work;
+	boost::scoped_ptr<boost::thread> thread;
 
 	std::set<AMX*> interfaces;
-	std::queue<Data::Message> messages;
+	Data::EventQueue eventQueues[EVENT_CLASSES];
+	std::size_t queuedMessages;
+
+	std::size_t highWatermark;
+	std::size_t lowWatermark;
+	std::set<int> pausedClients;
+	std::size_t readPauses;
+
+	Profiler profiler;
+	Router router;
+
+	int lastQueryID;
+	std::map<int, Data::Query> queryResults;
 
 	std::map<int, SharedClient> clients;
+	std::map<std::string, SharedNetwork> networks;
 	GroupMap groups;
 };
 
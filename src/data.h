@@ -17,6 +17,14 @@
 #ifndef DATA_H
 #define DATA_H
 
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <ctime>
+#include <deque>
+#include <list>
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
@@ -33,6 +41,8 @@ namespace Data
 		OnInvitedToChannel,
 		OnKickedFromChannel,
 		OnUserDisconnect,
+		OnNetSplit,
+		OnNetJoin,
 		OnUserJoinChannel,
 		OnUserLeaveChannel,
 		OnUserKickedFromChannel,
@@ -44,7 +54,36 @@ namespace Data
 		OnUserRequestCTCP,
 		OnUserReplyCTCP,
 		OnReceiveNumeric,
-		OnReceiveRaw
+		OnReceiveRaw,
+		OnQueryResult
+	};
+
+	enum DropPolicies
+	{
+		DropOldest,
+		DropNewest
+	};
+
+	enum EventClasses
+	{
+		LifecycleEvents,
+		ChatEvents,
+		MembershipEvents,
+		RawEvents
+	};
+
+	enum QueryErrors
+	{
+		QueryDisconnected = -2,
+		QueryTimedOut = -1
+	};
+
+	enum QueryTypes
+	{
+		WhoisQuery,
+		WhoQuery,
+		ListQuery,
+		ModeQuery
 	};
 
 	enum Settings
@@ -53,13 +92,158 @@ namespace Data
 		ConnectDelay,
 		ConnectTimeout,
 		ReceiveTimeout,
-		Respawn
+		Respawn,
+		Charset,
+		Formatting,
+		OutboxSize,
+		OutboxTTL,
+		RelayWindow,
+		RelaySize
+	};
+
+	struct CallbackProfile
+	{
+		CallbackProfile() : calls(0), maxTime(0), totalTime(0) {}
+
+		boost::uint64_t calls;
+		std::vector<boost::uint64_t> histogram;
+		boost::uint64_t maxTime;
+		boost::uint64_t totalTime;
+	};
+
+	struct Channel
+	{
+		Channel() : creationTime(0), generation(0), id(0), topicTime(0) {}
+
+		std::set<int> bots;
+		int creationTime;
+		int generation;
+		int id;
+		std::map<char, std::string> modes;
+		std::string topic;
+		std::string topicSetter;
+		int topicTime;
+		std::vector<const std::string*> users;
+	};
+
+	struct DepartedUser
+	{
+		std::vector<std::string> channels;
+		std::list<std::string>::iterator order;
+	};
+
+	struct DesiredChannel
+	{
+		DesiredChannel() : attempts(0), retryTime(0) {}
+
+		int attempts;
+		std::string key;
+		std::time_t retryTime;
+	};
+
+	struct Membership
+	{
+		Membership(int channel, int ranks = 0) : channel(channel), ranks(static_cast<unsigned char>(ranks)) {}
+
+		bool operator<(const Membership &membership) const
+		{
+			return channel < membership.channel;
+		}
+
+		int channel;
+		unsigned char ranks;
+	};
+
+	struct NetSplit
+	{
+		NetSplit() : time(0) {}
+
+		std::set<std::string> channels;
+		std::string host;
+		std::time_t time;
+		std::set<std::string> users;
+	};
+
+	struct OutboxMessage
+	{
+		std::string command;
+		std::time_t expiry;
+		std::string target;
+		std::string text;
+	};
+
+	struct QueryRow
+	{
+		std::vector<std::string> fields;
+		int numeric;
+	};
+
+	struct Query
+	{
+		Query() : botID(0), error(0), expiry(0), id(0), kept(false), maxUsers(0), minUsers(0), scriptID(0), type(0) {}
+
+		std::string argument;
+		int botID;
+		std::string callback;
+		int error;
+		std::time_t expiry;
+		int id;
+		bool kept;
+		int maxUsers;
+		int minUsers;
+		std::vector<QueryRow> rows;
+		int scriptID;
+		std::string target;
+		int type;
+	};
+
+	struct RelayBuffer
+	{
+		boost::posix_time::ptime deadline;
+		std::string text;
+	};
+
+	struct ScheduledMessage
+	{
+		ScheduledMessage() : interval(0) {}
+
+		int interval;
+		boost::posix_time::ptime nextTime;
+		std::string target;
+		std::string text;
+	};
+
+	struct User
+	{
+		User() : away(false) {}
+
+		std::string account;
+		bool away;
+		std::string host;
+		std::string ident;
 	};
 
 	struct Message
 	{
 		std::vector<int> array;
 		std::vector<std::string> buffer;
+#ifdef IRC_TRACE
+		boost::uint64_t timestamp;
+#endif
+	};
+
+	struct EventQueue
+	{
+		EventQueue() : bytes(0), credit(0), dropped(0), maxBytes(0), maxMessages(0), policy(DropOldest), weight(1) {}
+
+		std::size_t bytes;
+		int credit;
+		std::size_t dropped;
+		std::size_t maxBytes;
+		std::size_t maxMessages;
+		std::deque<Message> messages;
+		int policy;
+		int weight;
 	};
 }
 
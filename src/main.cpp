@@ -18,14 +18,17 @@
 
 #include "core.h"
 #include "natives.h"
+#include "trace.h"
 
+#include <boost/cstdint.hpp>
 #include <boost/scoped_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include <sdk/plugin.h>
 
-#include <queue>
+#include <map>
 #include <set>
+#include <vector>
 
 logprintf_t logprintf;
 
@@ -45,6 +48,9 @@ PLUGIN_EXPORT bool PLUGIN_CALL Load(void **ppPluginData)
 
 PLUGIN_EXPORT void PLUGIN_CALL Unload()
 {
+	// Handlers on the network thread dereference core, so the thread has to
+	// finish before core is destroyed
+	core->stop();
 	core.reset();
 	logprintf("\n\n*** IRC Plugin v%s by Incognito unloaded ***\n", PLUGIN_VERSION);
 }
@@ -59,11 +65,23 @@ AMX_NATIVE_INFO natives[] =
 	{ "IRC_SetMode", Natives::IRC_SetMode },
 	{ "IRC_Say", Natives::IRC_Say },
 	{ "IRC_Notice", Natives::IRC_Notice },
+	{ "IRC_SayMulti", Natives::IRC_SayMulti },
+	{ "IRC_NoticeMulti", Natives::IRC_NoticeMulti },
 	{ "IRC_IsUserOnChannel", Natives::IRC_IsUserOnChannel },
 	{ "IRC_InviteUser", Natives::IRC_InviteUser },
 	{ "IRC_KickUser", Natives::IRC_KickUser },
 	{ "IRC_GetUserChannelMode", Natives::IRC_GetUserChannelMode },
 	{ "IRC_GetChannelUserList", Natives::IRC_GetChannelUserList },
+	{ "IRC_GetChannelUserCount", Natives::IRC_GetChannelUserCount },
+	{ "IRC_GetChannelUser", Natives::IRC_GetChannelUser },
+	{ "IRC_GetChannelUsers", Natives::IRC_GetChannelUsers },
+	{ "IRC_GetChannelTopic", Natives::IRC_GetChannelTopic },
+	{ "IRC_GetChannelTopicInfo", Natives::IRC_GetChannelTopicInfo },
+	{ "IRC_GetChannelModes", Natives::IRC_GetChannelModes },
+	{ "IRC_GetChannelCreationTime", Natives::IRC_GetChannelCreationTime },
+	{ "IRC_GetUserHost", Natives::IRC_GetUserHost },
+	{ "IRC_GetUserAccount", Natives::IRC_GetUserAccount },
+	{ "IRC_IsUserAway", Natives::IRC_IsUserAway },
 	{ "IRC_SetChannelTopic", Natives::IRC_SetChannelTopic },
 	{ "IRC_RequestCTCP", Natives::IRC_RequestCTCP },
 	{ "IRC_ReplyCTCP", Natives::IRC_ReplyCTCP },
@@ -75,30 +93,126 @@ AMX_NATIVE_INFO natives[] =
 	{ "IRC_GroupSay", Natives::IRC_GroupSay },
 	{ "IRC_GroupNotice", Natives::IRC_GroupNotice },
 	{ "IRC_SetIntData", Natives::IRC_SetIntData },
+	{ "IRC_StartCapture", Natives::IRC_StartCapture },
+	{ "IRC_StopCapture", Natives::IRC_StopCapture },
+	{ "IRC_WriteTrace", Natives::IRC_WriteTrace },
+	{ "IRC_SetProfiling", Natives::IRC_SetProfiling },
+	{ "IRC_GetScriptID", Natives::IRC_GetScriptID },
+	{ "IRC_GetSlowCallback", Natives::IRC_GetSlowCallback },
+	{ "IRC_GetCallbackHistogram", Natives::IRC_GetCallbackHistogram },
+	{ "IRC_SetQueueLimits", Natives::IRC_SetQueueLimits },
+	{ "IRC_GetQueueStats", Natives::IRC_GetQueueStats },
+	{ "IRC_SetEventClassLimits", Natives::IRC_SetEventClassLimits },
+	{ "IRC_SetEventClassWeight", Natives::IRC_SetEventClassWeight },
+	{ "IRC_GetEventClassStats", Natives::IRC_GetEventClassStats },
+	{ "IRC_Subscribe", Natives::IRC_Subscribe },
+	{ "IRC_Unsubscribe", Natives::IRC_Unsubscribe },
+	{ "IRC_Whois", Natives::IRC_Whois },
+	{ "IRC_Who", Natives::IRC_Who },
+	{ "IRC_ListChannels", Natives::IRC_ListChannels },
+	{ "IRC_QueryMode", Natives::IRC_QueryMode },
+	{ "IRC_GetResultRows", Natives::IRC_GetResultRows },
+	{ "IRC_GetResultNumeric", Natives::IRC_GetResultNumeric },
+	{ "IRC_GetResultFields", Natives::IRC_GetResultFields },
+	{ "IRC_GetResultField", Natives::IRC_GetResultField },
+	{ "IRC_KeepResult", Natives::IRC_KeepResult },
+	{ "IRC_FreeResult", Natives::IRC_FreeResult },
+	{ "IRC_ScheduleSay", Natives::IRC_ScheduleSay },
+	{ "IRC_CancelScheduledSay", Natives::IRC_CancelScheduledSay },
 	{ 0, 0 }
 };
 
 PLUGIN_EXPORT int PLUGIN_CALL AmxLoad(AMX *amx)
 {
 	core->interfaces.insert(amx);
+	core->profiler.addScript(amx);
 	return amx_Register(amx, natives, -1);
 }
 
 PLUGIN_EXPORT int PLUGIN_CALL AmxUnload(AMX *amx)
 {
+	boost::mutex::scoped_lock lock(core->mutex);
+	core->removeQueries(core->profiler.getScriptID(amx));
+	lock.unlock();
 	core->interfaces.erase(amx);
+	core->profiler.removeScript(amx);
+	core->router.removeScript(amx);
 	return AMX_ERR_NONE;
 }
 
+static void executeCallback(AMX *amx, int index, const char *name, int botID)
+{
+	TRACE_SPAN(name);
+	if (core->profiler.isRunning())
+	{
+		boost::uint64_t start = core->profiler.now();
+		amx_Exec(amx, NULL, index);
+		core->profiler.record(amx, name, botID, core->profiler.now() - start);
+		return;
+	}
+	amx_Exec(amx, NULL, index);
+}
+
+static void executeQueryCallback(const Data::Message &message)
+{
+	// Query results go only to the script that sent the query, which may
+	// keep the result past the callback with IRC_KeepResult
+	for (std::set<AMX*>::iterator a = core->interfaces.begin(); a != core->interfaces.end(); ++a)
+	{
+		if (core->profiler.getScriptID(*a) == message.array.at(4))
+		{
+			cell amxAddress = 0;
+			int amxIndex = 0;
+			if (!amx_FindPublic(*a, message.buffer.at(1).c_str(), &amxIndex))
+			{
+				amx_Push(*a, message.array.at(3));
+				amx_PushString(*a, &amxAddress, NULL, message.buffer.at(0).c_str(), 0, 0);
+				amx_Push(*a, message.array.at(2));
+				amx_Push(*a, message.array.at(1));
+				// Trace spans keep the name pointer until IRC_WriteTrace, so the
+				// script's callback name cannot be used here
+				executeCallback(*a, amxIndex, "IRC_OnQueryResult", message.array.at(1));
+				amx_Release(*a, amxAddress);
+			}
+			break;
+		}
+	}
+	boost::mutex::scoped_lock lock(core->mutex);
+	std::map<int, Data::Query>::iterator q = core->queryResults.find(message.array.at(2));
+	if (q != core->queryResults.end() && !q->second.kept)
+	{
+		core->queryResults.erase(q);
+	}
+}
+
 PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 {
-	if (!core->messages.empty())
+	if (core->queuedMessages)
 	{
+		TRACE_BEGIN(lockSpan, "core->mutex wait");
 		boost::mutex::scoped_lock lock(core->mutex);
-		Data::Message message(core->messages.front());
-		core->messages.pop();
+		TRACE_END(lockSpan);
+		TRACE_BEGIN(popSpan, "Core::messages pop");
+		Data::Message message;
+		if (!core->popMessage(message))
+		{
+			return;
+		}
+		if (!core->pausedClients.empty() && core->queuedMessages <= core->lowWatermark)
+		{
+			core->resumeReads();
+		}
+		TRACE_END(popSpan);
 		lock.unlock();
-		for (std::set<AMX*>::iterator a = core->interfaces.begin(); a != core->interfaces.end(); ++a)
+		TRACE_RECORD("Core::messages wait", message.timestamp);
+		if (message.array.at(0) == Data::OnQueryResult)
+		{
+			executeQueryCallback(message);
+			return;
+		}
+		std::vector<AMX*> targets;
+		core->router.getTargets(message, core->interfaces, targets);
+		for (std::vector<AMX*>::iterator a = targets.begin(); a != targets.end(); ++a)
 		{
 			cell amxAddresses[5] = { 0 };
 			int amxIndex = 0;
@@ -111,7 +225,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_Push(*a, message.array.at(1));
 						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(0).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(2));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnConnect", message.array.at(2));
 						amx_Release(*a, amxAddresses[0]);
 					}
 					break;
@@ -124,7 +238,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_Push(*a, message.array.at(1));
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(2));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnDisconnect", message.array.at(2));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 					}
@@ -137,7 +251,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_Push(*a, message.array.at(1));
 						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(0).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(2));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnConnectAttempt", message.array.at(2));
 						amx_Release(*a, amxAddresses[0]);
 					}
 					break;
@@ -150,7 +264,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_Push(*a, message.array.at(1));
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(2));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnConnectAttemptFail", message.array.at(2));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 					}
@@ -162,7 +276,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 					{
 						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(0).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnJoinChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 					}
 					break;
@@ -174,7 +288,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(0).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnLeaveChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 					}
@@ -188,7 +302,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnInvitedToChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -204,7 +318,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnKickedFromChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -220,13 +334,49 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserDisconnect", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
 					}
 					break;
 				}
+				case Data::OnNetSplit:
+				{
+					if (!amx_FindPublic(*a, "IRC_OnNetSplit", &amxIndex))
+					{
+						amx_Push(*a, message.array.at(2));
+						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(3).c_str(), 0, 0);
+						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(2).c_str(), 0, 0);
+						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(1).c_str(), 0, 0);
+						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(0).c_str(), 0, 0);
+						amx_Push(*a, message.array.at(1));
+						executeCallback(*a, amxIndex, "IRC_OnNetSplit", message.array.at(1));
+						amx_Release(*a, amxAddresses[0]);
+						amx_Release(*a, amxAddresses[1]);
+						amx_Release(*a, amxAddresses[2]);
+						amx_Release(*a, amxAddresses[3]);
+					}
+					break;
+				}
+				case Data::OnNetJoin:
+				{
+					if (!amx_FindPublic(*a, "IRC_OnNetJoin", &amxIndex))
+					{
+						amx_Push(*a, message.array.at(2));
+						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(3).c_str(), 0, 0);
+						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(2).c_str(), 0, 0);
+						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(1).c_str(), 0, 0);
+						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(0).c_str(), 0, 0);
+						amx_Push(*a, message.array.at(1));
+						executeCallback(*a, amxIndex, "IRC_OnNetJoin", message.array.at(1));
+						amx_Release(*a, amxAddresses[0]);
+						amx_Release(*a, amxAddresses[1]);
+						amx_Release(*a, amxAddresses[2]);
+						amx_Release(*a, amxAddresses[3]);
+					}
+					break;
+				}
 				case Data::OnUserJoinChannel:
 				{
 					if (!amx_FindPublic(*a, "IRC_OnUserJoinChannel", &amxIndex))
@@ -235,7 +385,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserJoinChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -251,7 +401,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserLeaveChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -269,7 +419,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[4], NULL, message.buffer.at(4).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserKickedFromChannel", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -286,7 +436,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserNickChange", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -302,7 +452,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserSetChannelMode", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -319,7 +469,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserSetChannelTopic", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -336,7 +486,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserSay", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -353,7 +503,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[3], NULL, message.buffer.at(3).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserNotice", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -369,7 +519,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserRequestCTCP", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -384,7 +534,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[1], NULL, message.buffer.at(1).c_str(), 0, 0);
 						amx_PushString(*a, &amxAddresses[2], NULL, message.buffer.at(2).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnUserReplyCTCP", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 						amx_Release(*a, amxAddresses[1]);
 						amx_Release(*a, amxAddresses[2]);
@@ -398,7 +548,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(0).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
 						amx_Push(*a, message.array.at(2));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnReceiveNumeric", message.array.at(2));
 						amx_Release(*a, amxAddresses[0]);
 					}
 					break;
@@ -409,7 +559,7 @@ PLUGIN_EXPORT void PLUGIN_CALL ProcessTick()
 					{
 						amx_PushString(*a, &amxAddresses[0], NULL, message.buffer.at(0).c_str(), 0, 0);
 						amx_Push(*a, message.array.at(1));
-						amx_Exec(*a, NULL, amxIndex);
+						executeCallback(*a, amxIndex, "IRC_OnReceiveRaw", message.array.at(1));
 						amx_Release(*a, amxAddresses[0]);
 					}
 					break;
@@ -17,18 +17,81 @@
 #include "natives.h"
 
 #include "client.h"
+#include "command.h"
 #include "core.h"
 #include "main.h"
+#include "network.h"
+#include "profiler.h"
+#include "text.h"
+#include "trace.h"
 
 #include <boost/asio.hpp>
-#include <boost/format.hpp>
+#include <boost/cstdint.hpp>
 #include <boost/shared_ptr.hpp>
 #include <boost/thread.hpp>
 
 #include <sdk/plugin.h>
 
+#include <algorithm>
+#include <cstring>
 #include <map>
 #include <string>
+#include <vector>
+
+static bool getStringArray(AMX *amx, cell parameter, int count, std::vector<std::string> &strings)
+{
+	cell *array = NULL;
+	if (count < 0 || amx_GetAddr(amx, parameter, &array))
+	{
+		return false;
+	}
+	for (int i = 0; i < count; ++i)
+	{
+		// Two-dimensional arrays start with one cell per row holding the byte
+		// offset from that cell to the row's data.
+		cell *row = reinterpret_cast<cell*>(reinterpret_cast<unsigned char*>(&array[i]) + array[i]);
+		int length = 0;
+		amx_StrLen(row, &length);
+		std::vector<char> buffer(length + 1);
+		amx_GetString(&buffer[0], row, 0, buffer.size());
+		strings.push_back(&buffer[0]);
+	}
+	return true;
+}
+
+static cell sendQuery(AMX *amx, cell botID, int type, const char *target, const char *argument, const char *callback, int minUsers = 0, int maxUsers = 0)
+{
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(botID));
+	if (c == core->clients.end())
+	{
+		return 0;
+	}
+	Data::Query query;
+	query.argument = argument;
+	query.botID = c->first;
+	query.callback = callback;
+	query.id = core->lastQueryID + 1;
+	query.maxUsers = maxUsers;
+	query.minUsers = minUsers;
+	query.scriptID = core->profiler.getScriptID(amx);
+	query.target = target;
+	query.type = type;
+	if (!c->second->sendQuery(query))
+	{
+		return 0;
+	}
+	return static_cast<cell>(++core->lastQueryID);
+}
+
+static Data::QueryRow *getQueryRow(cell queryID, cell row)
+{
+	std::map<int, Data::Query>::iterator q = core->queryResults.find(static_cast<int>(queryID));
+	if (q == core->queryResults.end() || row < 0 || static_cast<std::size_t>(row) >= q->second.rows.size())
+	{
+		return NULL;
+	}
+	return &q->second.rows[row];
+}
 
 cell AMX_NATIVE_CALL Natives::IRC_Connect(AMX *amx, cell *params)
 {
@@ -100,7 +163,8 @@ cell AMX_NATIVE_CALL Natives::IRC_Quit(AMX *amx, cell *params)
 		c->second->quitting = true;
 		if (c->second->connected)
 		{
-			c->second->sendAsync(boost::str(boost::format("QUIT :%1%\r\n") % (message ? message : "")));
+			c->second->flushRelayBuffers();
+			Command(*c->second, "QUIT").trailing(message ? message : "").send();
 			c->second->stopAsync();
 		}
 		else
@@ -127,8 +191,7 @@ cell AMX_NATIVE_CALL Natives::IRC_JoinChannel(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("JOIN %1% %2%\r\n") % channel % (key ? key : "")));
-		return 1;
+		return c->second->joinChannel(channel, key ? key : "");
 	}
 	return 0;
 }
@@ -148,8 +211,8 @@ cell AMX_NATIVE_CALL Natives::IRC_PartChannel(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("PART %1% :%2%\r\n") % channel % (message ? message : "")));
-		return 1;
+		c->second->partChannel(channel);
+		return Command(*c->second, "PART").parameter(channel).trailing(message ? message : "").send();
 	}
 	return 0;
 }
@@ -167,8 +230,7 @@ cell AMX_NATIVE_CALL Natives::IRC_ChangeNick(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("NICK %1%\r\n") % nickname));
-		return 1;
+		return Command(*c->second, "NICK").parameter(nickname).send();
 	}
 	return 0;
 }
@@ -192,8 +254,7 @@ cell AMX_NATIVE_CALL Natives::IRC_SetMode(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("MODE %1% %2%\r\n") % target % mode));
-		return 1;
+		return Command(*c->second, "MODE").parameter(target).parameter(mode).send();
 	}
 	return 0;
 }
@@ -217,8 +278,7 @@ cell AMX_NATIVE_CALL Natives::IRC_Say(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("PRIVMSG %1% :%2%\r\n") % target % message));
-		return 1;
+		return c->second->sendMessage("PRIVMSG", target, message);
 	}
 	return 0;
 }
@@ -242,8 +302,53 @@ cell AMX_NATIVE_CALL Natives::IRC_Notice(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("NOTICE %1% :%2%\r\n") % target % message));
-		return 1;
+		return c->second->sendMessage("NOTICE", target, message);
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SayMulti(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(4, "IRC_SayMulti");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		std::vector<std::string> targets;
+		if (!getStringArray(amx, params[2], static_cast<int>(params[4]), targets))
+		{
+			return 0;
+		}
+		return c->second->sendMessage("PRIVMSG", targets, message);
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_NoticeMulti(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(4, "IRC_NoticeMulti");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		std::vector<std::string> targets;
+		if (!getStringArray(amx, params[2], static_cast<int>(params[4]), targets))
+		{
+			return 0;
+		}
+		return c->second->sendMessage("NOTICE", targets, message);
 	}
 	return 0;
 }
@@ -267,14 +372,9 @@ cell AMX_NATIVE_CALL Natives::IRC_IsUserOnChannel(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		UserMap::iterator f = c->second->users.find(user);
-		if (f != c->second->users.end())
+		if (c->second->network->getMembership(channel, user))
 		{
-			std::map<std::string, std::string>::iterator g = f->second.find(channel);
-			if (g != f->second.end())
-			{
-				return 1;
-			}
+			return 1;
 		}
 	}
 	return 0;
@@ -299,8 +399,7 @@ cell AMX_NATIVE_CALL Natives::IRC_InviteUser(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("INVITE %1% %2%\r\n") % user % channel));
-		return 1;
+		return Command(*c->second, "INVITE").parameter(user).parameter(channel).send();
 	}
 	return 0;
 }
@@ -326,8 +425,7 @@ cell AMX_NATIVE_CALL Natives::IRC_KickUser(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("KICK %1% %2% :%3%\r\n") % channel % user % (message ? message : "")));
-		return 1;
+		return Command(*c->second, "KICK").parameter(channel).parameter(user).trailing(message ? message : "").send();
 	}
 	return 0;
 }
@@ -352,14 +450,10 @@ cell AMX_NATIVE_CALL Natives::IRC_GetUserChannelMode(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		UserMap::iterator f = c->second->users.find(user);
-		if (f != c->second->users.end())
+		const Data::Membership *membership = c->second->network->getMembership(channel, user);
+		if (membership)
 		{
-			std::map<std::string, std::string>::iterator g = f->second.find(channel);
-			if (g != f->second.end())
-			{
-				mode = g->second;
-			}
+			mode = c->second->network->getRankPrefix(membership->ranks);
 		}
 	}
 	if (mode.empty())
@@ -388,12 +482,17 @@ cell AMX_NATIVE_CALL Natives::IRC_GetChannelUserList(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		for (UserMap::iterator u = c->second->users.begin(); u != c->second->users.end(); ++u)
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
 		{
-			std::map<std::string, std::string>::iterator f = u->second.find(channel);
-			if (f != u->second.end())
+			for (std::vector<const std::string*>::iterator u = d->second.users.begin(); u != d->second.users.end(); ++u)
 			{
-				userList += f->second + u->first + " ";
+				const Data::Membership *membership = c->second->network->getMembership(d->second.id, **u);
+				if (membership)
+				{
+					userList += c->second->network->getRankPrefix(membership->ranks);
+				}
+				userList += **u + " ";
 			}
 		}
 	}
@@ -413,9 +512,9 @@ cell AMX_NATIVE_CALL Natives::IRC_GetChannelUserList(AMX *amx, cell *params)
 	return 1;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_SetChannelTopic(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelUserCount(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(3, "IRC_SetChannelTopic");
+	CHECK_PARAMS(3, "IRC_GetChannelUserCount");
 	boost::mutex::scoped_lock lock(core->mutex);
 	char *channel = NULL;
 	amx_StrParam(amx, params[2], channel);
@@ -423,224 +522,462 @@ cell AMX_NATIVE_CALL Natives::IRC_SetChannelTopic(AMX *amx, cell *params)
 	{
 		return 0;
 	}
-	char *topic = NULL;
-	amx_StrParam(amx, params[3], topic);
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("TOPIC %1% :%2%\r\n") % channel % (topic ? topic : "")));
-		return 1;
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
+		{
+			cell *generation = NULL;
+			if (!amx_GetAddr(amx, params[3], &generation))
+			{
+				*generation = static_cast<cell>(d->second.generation);
+			}
+			return static_cast<cell>(d->second.users.size());
+		}
 	}
 	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_RequestCTCP(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelUser(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(3, "IRC_RequestCTCP");
+	CHECK_PARAMS(5, "IRC_GetChannelUser");
 	boost::mutex::scoped_lock lock(core->mutex);
-	char *user = NULL;
-	amx_StrParam(amx, params[2], user);
-	if (user == NULL)
-	{
-		return 0;
-	}
-	char *message = NULL;
-	amx_StrParam(amx, params[3], message);
-	if (message == NULL)
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
 	{
 		return 0;
 	}
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("PRIVMSG %1% :\001%2%\001\r\n") % user % message));
-		return 1;
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
+		{
+			std::size_t index = static_cast<std::size_t>(params[3]);
+			if (params[3] >= 0 && params[5] > 0 && index < d->second.users.size())
+			{
+				cell *destination = NULL;
+				if (!amx_GetAddr(amx, params[4], &destination))
+				{
+					amx_SetString(destination, d->second.users[index]->c_str(), 0, 0, static_cast<std::size_t>(params[5]));
+					return 1;
+				}
+			}
+		}
 	}
 	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_ReplyCTCP(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelUsers(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(3, "IRC_ReplyCTCP");
+	CHECK_PARAMS(6, "IRC_GetChannelUsers");
 	boost::mutex::scoped_lock lock(core->mutex);
-	char *user = NULL;
-	amx_StrParam(amx, params[2], user);
-	if (user == NULL)
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
 	{
 		return 0;
 	}
-	char *message = NULL;
-	amx_StrParam(amx, params[3], message);
-	if (message == NULL)
+	if (params[4] < 0 || params[5] <= 0 || params[6] <= 0)
 	{
 		return 0;
 	}
+	std::size_t count = 0;
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("NOTICE %1% :\001%2%\001\r\n") % user % message));
-		return 1;
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
+		{
+			cell *destination = NULL;
+			if (!amx_GetAddr(amx, params[3], &destination))
+			{
+				std::size_t start = static_cast<std::size_t>(params[4]);
+				std::size_t maxUsers = static_cast<std::size_t>(params[5]);
+				std::size_t maxLength = static_cast<std::size_t>(params[6]);
+				for (std::size_t i = start; i < d->second.users.size() && count < maxUsers; ++i, ++count)
+				{
+					// Two-dimensional arrays start with one cell per row holding the
+					// byte offset from that cell to the row's data.
+					cell *row = reinterpret_cast<cell*>(reinterpret_cast<unsigned char*>(&destination[count]) + destination[count]);
+					amx_SetString(row, d->second.users[i]->c_str(), 0, 0, maxLength);
+				}
+			}
+		}
 	}
-	return 0;
+	return static_cast<cell>(count);
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_SendRaw(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelTopic(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(2, "IRC_SendRaw");
+	CHECK_PARAMS(4, "IRC_GetChannelTopic");
 	boost::mutex::scoped_lock lock(core->mutex);
-	char *message = NULL;
-	amx_StrParam(amx, params[2], message);
-	if (message == NULL)
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
 	{
 		return 0;
 	}
 	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("%1%\r\n") % message));
-		return 1;
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
+		{
+			cell *destination = NULL;
+			if (!amx_GetAddr(amx, params[3], &destination))
+			{
+				amx_SetString(destination, d->second.topic.c_str(), 0, 0, static_cast<std::size_t>(params[4]));
+				return 1;
+			}
+		}
 	}
 	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_CreateGroup(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelTopicInfo(AMX *amx, cell *params)
 {
+	CHECK_PARAMS(5, "IRC_GetChannelTopicInfo");
 	boost::mutex::scoped_lock lock(core->mutex);
-	int groupID = 1;
-	for (GroupMap::iterator g = core->groups.begin(); g != core->groups.end(); ++g)
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
 	{
-		if (g->first != groupID)
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
 		{
-			break;
+			cell *destination = NULL, *time = NULL;
+			if (!amx_GetAddr(amx, params[3], &destination) && !amx_GetAddr(amx, params[4], &time))
+			{
+				amx_SetString(destination, d->second.topicSetter.c_str(), 0, 0, static_cast<std::size_t>(params[5]));
+				*time = static_cast<cell>(d->second.topicTime);
+				return 1;
+			}
 		}
-		++groupID;
 	}
-	core->groups.insert(std::make_pair(groupID, std::map<int, bool>()));
-	return static_cast<cell>(groupID);
+	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_DestroyGroup(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelModes(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(1, "IRC_DestroyGroup");
+	CHECK_PARAMS(4, "IRC_GetChannelModes");
 	boost::mutex::scoped_lock lock(core->mutex);
-	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
-	if (f != core->groups.end())
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
 	{
-		core->groups.erase(f);
-		return 1;
+		return 0;
 	}
-	return 0;
-}
-
-cell AMX_NATIVE_CALL Natives::IRC_AddToGroup(AMX *amx, cell *params)
-{
-	CHECK_PARAMS(2, "IRC_AddToGroup");
-	boost::mutex::scoped_lock lock(core->mutex);
-	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
-	if (f != core->groups.end())
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
 	{
-		std::map<int, bool>::iterator g = f->second.find(static_cast<int>(params[2]));
-		if (g == f->second.end())
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
 		{
-			std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[2]));
-			if (c != core->clients.end())
+			std::string modes = "+", modeParameters;
+			for (std::map<char, std::string>::iterator m = d->second.modes.begin(); m != d->second.modes.end(); ++m)
 			{
-				c->second->groupID = f->first;
+				modes += m->first;
+				if (!m->second.empty())
+				{
+					modeParameters += " " + m->second;
+				}
+			}
+			modes += modeParameters;
+			cell *destination = NULL;
+			if (!amx_GetAddr(amx, params[3], &destination))
+			{
+				amx_SetString(destination, modes.c_str(), 0, 0, static_cast<std::size_t>(params[4]));
+				return 1;
 			}
-			f->second.insert(std::make_pair(static_cast<int>(params[2]), false));
-			return 1;
 		}
 	}
 	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_RemoveFromGroup(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetChannelCreationTime(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(2, "IRC_RemoveFromGroup");
+	CHECK_PARAMS(2, "IRC_GetChannelCreationTime");
 	boost::mutex::scoped_lock lock(core->mutex);
-	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
-	if (f != core->groups.end())
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
 	{
-		std::map<int, bool>::iterator g = f->second.find(static_cast<int>(params[2]));
-		if (g != f->second.end())
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		ChannelMap::iterator d = c->second->network->channels.find(channel);
+		if (d != c->second->network->channels.end())
 		{
-			std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[2]));
-			if (c != core->clients.end())
-			{
-				c->second->groupID = 0;
-			}
-			f->second.erase(static_cast<int>(params[2]));
-			return 1;
+			return static_cast<cell>(d->second.creationTime);
 		}
 	}
 	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_GroupSay(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetUserHost(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(3, "IRC_GroupSay");
+	CHECK_PARAMS(6, "IRC_GetUserHost");
 	boost::mutex::scoped_lock lock(core->mutex);
-	char *target = NULL;
-	amx_StrParam(amx, params[2], target);
-	if (target == NULL)
-	{
-		return 0;
-	}
-	char *message = NULL;
-	amx_StrParam(amx, params[3], message);
-	if (message == NULL)
+	char *user = NULL;
+	amx_StrParam(amx, params[2], user);
+	if (user == NULL)
 	{
 		return 0;
 	}
-	int botID = 0;
-	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
-	if (f != core->groups.end())
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
 	{
-		if (f->second.empty())
-		{
-			return 0;
-		}
-		for (std::map<int, bool>::iterator g = f->second.begin(); g != f->second.end(); ++g)
-		{
-			if (!g->second)
-			{
-				botID = g->first;
-				g->second = true;
-				break;
-			}
-		}
-		if (!botID)
+		UserInfoMap::iterator f = c->second->network->userInfo.find(user);
+		if (f != c->second->network->userInfo.end() && !f->second.host.empty())
 		{
-			for (std::map<int, bool>::iterator g = f->second.begin(); g != f->second.end(); ++g)
+			cell *ident = NULL, *host = NULL;
+			if (!amx_GetAddr(amx, params[3], &ident) && !amx_GetAddr(amx, params[4], &host))
 			{
-				g->second = false;
+				amx_SetString(ident, f->second.ident.c_str(), 0, 0, static_cast<std::size_t>(params[5]));
+				amx_SetString(host, f->second.host.c_str(), 0, 0, static_cast<std::size_t>(params[6]));
+				return 1;
 			}
-			std::map<int, bool>::iterator g = f->second.begin();
-			botID = g->first;
-			g->second = true;
 		}
 	}
-	std::map<int, SharedClient>::iterator c = core->clients.find(botID);
-	if (c != core->clients.end())
-	{
-		c->second->sendAsync(boost::str(boost::format("PRIVMSG %1% :%2%\r\n") % target % message));
-		return 1;
-	}
 	return 0;
 }
 
-cell AMX_NATIVE_CALL Natives::IRC_GroupNotice(AMX *amx, cell *params)
+cell AMX_NATIVE_CALL Natives::IRC_GetUserAccount(AMX *amx, cell *params)
 {
-	CHECK_PARAMS(3, "IRC_GroupNotice");
+	CHECK_PARAMS(4, "IRC_GetUserAccount");
 	boost::mutex::scoped_lock lock(core->mutex);
-	char *target = NULL;
-	amx_StrParam(amx, params[2], target);
-	if (target == NULL)
+	char *user = NULL;
+	amx_StrParam(amx, params[2], user);
+	if (user == NULL)
 	{
 		return 0;
 	}
-	char *message = NULL;
-	amx_StrParam(amx, params[3], message);
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		UserInfoMap::iterator f = c->second->network->userInfo.find(user);
+		if (f != c->second->network->userInfo.end() && !f->second.account.empty())
+		{
+			cell *destination = NULL;
+			if (!amx_GetAddr(amx, params[3], &destination))
+			{
+				amx_SetString(destination, f->second.account.c_str(), 0, 0, static_cast<std::size_t>(params[4]));
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_IsUserAway(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_IsUserAway");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *user = NULL;
+	amx_StrParam(amx, params[2], user);
+	if (user == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		UserInfoMap::iterator f = c->second->network->userInfo.find(user);
+		if (f != c->second->network->userInfo.end())
+		{
+			return f->second.away;
+		}
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SetChannelTopic(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_SetChannelTopic");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
+	{
+		return 0;
+	}
+	char *topic = NULL;
+	amx_StrParam(amx, params[3], topic);
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		return Command(*c->second, "TOPIC").parameter(channel).trailing(topic ? topic : "").send();
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_RequestCTCP(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_RequestCTCP");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *user = NULL;
+	amx_StrParam(amx, params[2], user);
+	if (user == NULL)
+	{
+		return 0;
+	}
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		return Command(*c->second, "PRIVMSG").parameter(user).trailing("\001").append(message).append("\001").send();
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_ReplyCTCP(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_ReplyCTCP");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *user = NULL;
+	amx_StrParam(amx, params[2], user);
+	if (user == NULL)
+	{
+		return 0;
+	}
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		return Command(*c->second, "NOTICE").parameter(user).trailing("\001").append(message).append("\001").send();
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SendRaw(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_SendRaw");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *message = NULL;
+	amx_StrParam(amx, params[2], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		// Scripts often end raw lines with CRLF themselves
+		std::size_t length = std::strlen(message);
+		while (length && (message[length - 1] == '\r' || message[length - 1] == '\n'))
+		{
+			--length;
+		}
+		return Command(*c->second, message, length).send();
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_CreateGroup(AMX *amx, cell *params)
+{
+	boost::mutex::scoped_lock lock(core->mutex);
+	int groupID = 1;
+	for (GroupMap::iterator g = core->groups.begin(); g != core->groups.end(); ++g)
+	{
+		if (g->first != groupID)
+		{
+			break;
+		}
+		++groupID;
+	}
+	core->groups.insert(std::make_pair(groupID, std::map<int, bool>()));
+	return static_cast<cell>(groupID);
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_DestroyGroup(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(1, "IRC_DestroyGroup");
+	boost::mutex::scoped_lock lock(core->mutex);
+	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
+	if (f != core->groups.end())
+	{
+		core->groups.erase(f);
+		return 1;
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_AddToGroup(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_AddToGroup");
+	boost::mutex::scoped_lock lock(core->mutex);
+	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
+	if (f != core->groups.end())
+	{
+		std::map<int, bool>::iterator g = f->second.find(static_cast<int>(params[2]));
+		if (g == f->second.end())
+		{
+			std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[2]));
+			if (c != core->clients.end())
+			{
+				c->second->groupID = f->first;
+			}
+			f->second.insert(std::make_pair(static_cast<int>(params[2]), false));
+			return 1;
+		}
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_RemoveFromGroup(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_RemoveFromGroup");
+	boost::mutex::scoped_lock lock(core->mutex);
+	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
+	if (f != core->groups.end())
+	{
+		std::map<int, bool>::iterator g = f->second.find(static_cast<int>(params[2]));
+		if (g != f->second.end())
+		{
+			std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[2]));
+			if (c != core->clients.end())
+			{
+				c->second->groupID = 0;
+			}
+			f->second.erase(static_cast<int>(params[2]));
+			return 1;
+		}
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GroupSay(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_GroupSay");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *target = NULL;
+	amx_StrParam(amx, params[2], target);
+	if (target == NULL)
+	{
+		return 0;
+	}
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
 	if (message == NULL)
 	{
 		return 0;
@@ -676,8 +1013,59 @@ cell AMX_NATIVE_CALL Natives::IRC_GroupNotice(AMX *amx, cell *params)
 	std::map<int, SharedClient>::iterator c = core->clients.find(botID);
 	if (c != core->clients.end())
 	{
-		c->second->sendAsync(boost::str(boost::format("NOTICE %1% :%2%\r\n") % target % message));
-		return 1;
+		return c->second->sendMessage("PRIVMSG", target, message);
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GroupNotice(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_GroupNotice");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *target = NULL;
+	amx_StrParam(amx, params[2], target);
+	if (target == NULL)
+	{
+		return 0;
+	}
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	int botID = 0;
+	GroupMap::iterator f = core->groups.find(static_cast<int>(params[1]));
+	if (f != core->groups.end())
+	{
+		if (f->second.empty())
+		{
+			return 0;
+		}
+		for (std::map<int, bool>::iterator g = f->second.begin(); g != f->second.end(); ++g)
+		{
+			if (!g->second)
+			{
+				botID = g->first;
+				g->second = true;
+				break;
+			}
+		}
+		if (!botID)
+		{
+			for (std::map<int, bool>::iterator g = f->second.begin(); g != f->second.end(); ++g)
+			{
+				g->second = false;
+			}
+			std::map<int, bool>::iterator g = f->second.begin();
+			botID = g->first;
+			g->second = true;
+		}
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(botID);
+	if (c != core->clients.end())
+	{
+		return c->second->sendMessage("NOTICE", target, message);
 	}
 	return 0;
 }
@@ -722,13 +1110,77 @@ cell AMX_NATIVE_CALL Natives::IRC_SetIntData(AMX *amx, cell *params)
 				restart = true;
 				break;
 			}
-			default:
+			case Data::Charset:
 			{
-				logprintf("*** IRC_SetIntData: Invalid data specified");
-				break;
+				if (params[3] < Text::UTF8 || params[3] > Text::Windows1252)
+				{
+					logprintf("*** IRC_SetIntData: Invalid charset specified");
+					return 0;
+				}
+				c->second->charset = static_cast<int>(params[3]);
+				return 1;
 			}
-		}
-		if (restart)
+			case Data::Formatting:
+			{
+				if (params[3] < Text::KeepFormatting || params[3] > Text::TranslateFormatting)
+				{
+					logprintf("*** IRC_SetIntData: Invalid formatting mode specified");
+					return 0;
+				}
+				c->second->formatting = static_cast<int>(params[3]);
+				return 1;
+			}
+			case Data::OutboxSize:
+			{
+				if (params[3] < 0)
+				{
+					logprintf("*** IRC_SetIntData: Invalid outbox size specified");
+					return 0;
+				}
+				c->second->outboxSize = static_cast<std::size_t>(params[3]);
+				return 1;
+			}
+			case Data::OutboxTTL:
+			{
+				if (params[3] <= 0)
+				{
+					logprintf("*** IRC_SetIntData: Invalid outbox TTL specified");
+					return 0;
+				}
+				c->second->outboxTTL = static_cast<int>(params[3]);
+				return 1;
+			}
+			case Data::RelayWindow:
+			{
+				if (params[3] < 0)
+				{
+					logprintf("*** IRC_SetIntData: Invalid relay window specified");
+					return 0;
+				}
+				c->second->relayWindow = static_cast<int>(params[3]);
+				if (!c->second->relayWindow)
+				{
+					c->second->flushRelayBuffers();
+				}
+				return 1;
+			}
+			case Data::RelaySize:
+			{
+				if (params[3] < 0)
+				{
+					logprintf("*** IRC_SetIntData: Invalid relay size specified");
+					return 0;
+				}
+				c->second->relaySize = static_cast<std::size_t>(params[3]);
+				return 1;
+			}
+			default:
+			{
+				logprintf("*** IRC_SetIntData: Invalid data specified");
+				break;
+			}
+		}
+		if (restart)
 		{
 			if (!c->second->connected && c->second->socketOpen())
 			{
@@ -740,3 +1192,492 @@ cell AMX_NATIVE_CALL Natives::IRC_SetIntData(AMX *amx, cell *params)
 	}
 	return 0;
 }
+
+cell AMX_NATIVE_CALL Natives::IRC_StartCapture(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_StartCapture");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *fileName = NULL;
+	amx_StrParam(amx, params[2], fileName);
+	if (fileName == NULL)
+	{
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		if (c->second->capture.open(fileName))
+		{
+			return 1;
+		}
+		logprintf("*** IRC_StartCapture: Error opening capture file \"%s\"", fileName);
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_StopCapture(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(1, "IRC_StopCapture");
+	boost::mutex::scoped_lock lock(core->mutex);
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		if (c->second->capture.isOpen())
+		{
+			c->second->capture.close();
+			return 1;
+		}
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_WriteTrace(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(1, "IRC_WriteTrace");
+	char *fileName = NULL;
+	amx_StrParam(amx, params[1], fileName);
+	if (fileName == NULL)
+	{
+		return 0;
+	}
+#ifdef IRC_TRACE
+	if (Trace::write(fileName))
+	{
+		return 1;
+	}
+	logprintf("*** IRC_WriteTrace: Error writing trace file \"%s\"", fileName);
+#else
+	logprintf("*** IRC_WriteTrace: Tracing is not enabled in this build (compile with IRC_TRACE defined)");
+#endif
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SetProfiling(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_SetProfiling");
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (params[1])
+	{
+		if (params[2] < 0)
+		{
+			logprintf("*** IRC_SetProfiling: Invalid slow callback threshold supplied (%d)", static_cast<int>(params[2]));
+			return 0;
+		}
+		core->profiler.start(static_cast<int>(params[2]));
+	}
+	else
+	{
+		core->profiler.stop();
+	}
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetScriptID(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(0, "IRC_GetScriptID");
+	boost::mutex::scoped_lock lock(core->mutex);
+	return static_cast<cell>(core->profiler.getScriptID(amx));
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetSlowCallback(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(7, "IRC_GetSlowCallback");
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (params[1] < 0)
+	{
+		return 0;
+	}
+	int scriptID = 0;
+	std::string callback;
+	Data::CallbackProfile profile;
+	if (!core->profiler.getSlowCallback(static_cast<std::size_t>(params[1]), scriptID, callback, profile))
+	{
+		return 0;
+	}
+	// Times are in microseconds and saturate rather than wrap in a cell
+	const boost::uint64_t maxCell = 0x7FFFFFFF;
+	cell values[4] =
+	{
+		static_cast<cell>(scriptID),
+		static_cast<cell>(std::min(profile.calls, maxCell)),
+		static_cast<cell>(std::min(profile.totalTime, maxCell)),
+		static_cast<cell>(std::min(profile.maxTime, maxCell))
+	};
+	cell *destination = NULL;
+	if (!amx_GetAddr(amx, params[2], &destination))
+	{
+		amx_SetString(destination, callback.c_str(), 0, 0, static_cast<std::size_t>(params[7]));
+	}
+	for (int i = 0; i < 4; ++i)
+	{
+		if (!amx_GetAddr(amx, params[3 + i], &destination))
+		{
+			*destination = values[i];
+		}
+	}
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetCallbackHistogram(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(4, "IRC_GetCallbackHistogram");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *callback = NULL;
+	amx_StrParam(amx, params[2], callback);
+	if (callback == NULL)
+	{
+		return 0;
+	}
+	Data::CallbackProfile *profile = core->profiler.getCallbackProfile(static_cast<int>(params[1]), callback);
+	if (!profile)
+	{
+		return 0;
+	}
+	cell *destination = NULL;
+	if (params[4] < 0 || amx_GetAddr(amx, params[3], &destination))
+	{
+		return 0;
+	}
+	std::size_t count = std::min(static_cast<std::size_t>(params[4]), profile->histogram.size());
+	for (std::size_t i = 0; i < count; ++i)
+	{
+		destination[i] = static_cast<cell>(std::min<boost::uint64_t>(profile->histogram[i], 0x7FFFFFFF));
+	}
+	return static_cast<cell>(count);
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SetQueueLimits(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_SetQueueLimits");
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (params[1] < 0 || params[2] < 0 || (params[1] && params[2] >= params[1]))
+	{
+		logprintf("*** IRC_SetQueueLimits: Invalid watermarks supplied (%d, %d)", static_cast<int>(params[1]), static_cast<int>(params[2]));
+		return 0;
+	}
+	core->highWatermark = static_cast<std::size_t>(params[1]);
+	core->lowWatermark = static_cast<std::size_t>(params[2]);
+	if (!core->highWatermark || core->queuedMessages <= core->lowWatermark)
+	{
+		core->resumeReads();
+	}
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetQueueStats(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_GetQueueStats");
+	boost::mutex::scoped_lock lock(core->mutex);
+	cell values[3] =
+	{
+		static_cast<cell>(core->queuedMessages),
+		static_cast<cell>(core->pausedClients.size()),
+		static_cast<cell>(core->readPauses)
+	};
+	for (int i = 0; i < 3; ++i)
+	{
+		cell *destination = NULL;
+		if (!amx_GetAddr(amx, params[1 + i], &destination))
+		{
+			*destination = values[i];
+		}
+	}
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SetEventClassLimits(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(4, "IRC_SetEventClassLimits");
+	if (params[1] < 0 || params[1] >= EVENT_CLASSES)
+	{
+		logprintf("*** IRC_SetEventClassLimits: Invalid event class ID supplied (%d)", static_cast<int>(params[1]));
+		return 0;
+	}
+	if (params[2] < 0 || params[3] < 0 || (params[4] != Data::DropOldest && params[4] != Data::DropNewest))
+	{
+		logprintf("*** IRC_SetEventClassLimits: Invalid limits supplied (%d, %d, %d)", static_cast<int>(params[2]), static_cast<int>(params[3]), static_cast<int>(params[4]));
+		return 0;
+	}
+	boost::mutex::scoped_lock lock(core->mutex);
+	Data::EventQueue &eventQueue = core->eventQueues[params[1]];
+	eventQueue.maxMessages = static_cast<std::size_t>(params[2]);
+	eventQueue.maxBytes = static_cast<std::size_t>(params[3]);
+	eventQueue.policy = static_cast<int>(params[4]);
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_SetEventClassWeight(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_SetEventClassWeight");
+	if (params[1] < 0 || params[1] >= EVENT_CLASSES)
+	{
+		logprintf("*** IRC_SetEventClassWeight: Invalid event class ID supplied (%d)", static_cast<int>(params[1]));
+		return 0;
+	}
+	if (params[2] < 1 || params[2] > 1000)
+	{
+		logprintf("*** IRC_SetEventClassWeight: Invalid weight supplied (%d)", static_cast<int>(params[2]));
+		return 0;
+	}
+	boost::mutex::scoped_lock lock(core->mutex);
+	core->eventQueues[params[1]].weight = static_cast<int>(params[2]);
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetEventClassStats(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(4, "IRC_GetEventClassStats");
+	if (params[1] < 0 || params[1] >= EVENT_CLASSES)
+	{
+		logprintf("*** IRC_GetEventClassStats: Invalid event class ID supplied (%d)", static_cast<int>(params[1]));
+		return 0;
+	}
+	boost::mutex::scoped_lock lock(core->mutex);
+	const Data::EventQueue &eventQueue = core->eventQueues[params[1]];
+	cell values[3] =
+	{
+		static_cast<cell>(eventQueue.messages.size()),
+		static_cast<cell>(eventQueue.bytes),
+		static_cast<cell>(eventQueue.dropped)
+	};
+	for (int i = 0; i < 3; ++i)
+	{
+		cell *destination = NULL;
+		if (!amx_GetAddr(amx, params[2 + i], &destination))
+		{
+			*destination = values[i];
+		}
+	}
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_Subscribe(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_Subscribe");
+	if (params[1] < 0)
+	{
+		logprintf("*** IRC_Subscribe: Invalid bot ID supplied (%d)", static_cast<int>(params[1]));
+		return 0;
+	}
+	if (!params[3])
+	{
+		logprintf("*** IRC_Subscribe: No callbacks supplied");
+		return 0;
+	}
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	core->router.addRoute(amx, static_cast<int>(params[1]), channel ? channel : "", static_cast<unsigned int>(params[3]));
+	return 1;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_Unsubscribe(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_Unsubscribe");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (core->router.removeRoute(amx, static_cast<int>(params[1]), channel ? channel : ""))
+	{
+		return 1;
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_Whois(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_Whois");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *nick = NULL;
+	amx_StrParam(amx, params[2], nick);
+	if (nick == NULL)
+	{
+		return 0;
+	}
+	char *callback = NULL;
+	amx_StrParam(amx, params[3], callback);
+	if (callback == NULL)
+	{
+		return 0;
+	}
+	return sendQuery(amx, params[1], Data::WhoisQuery, nick, "", callback);
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_Who(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(3, "IRC_Who");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *mask = NULL;
+	amx_StrParam(amx, params[2], mask);
+	if (mask == NULL)
+	{
+		return 0;
+	}
+	char *callback = NULL;
+	amx_StrParam(amx, params[3], callback);
+	if (callback == NULL)
+	{
+		return 0;
+	}
+	return sendQuery(amx, params[1], Data::WhoQuery, mask, "", callback);
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_ListChannels(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(5, "IRC_ListChannels");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *callback = NULL;
+	amx_StrParam(amx, params[2], callback);
+	if (callback == NULL)
+	{
+		return 0;
+	}
+	if (params[3] < 0 || params[4] < 0 || (params[4] && params[4] < params[3]))
+	{
+		logprintf("*** IRC_ListChannels: Invalid user counts supplied (%d, %d)", static_cast<int>(params[3]), static_cast<int>(params[4]));
+		return 0;
+	}
+	char *mask = NULL;
+	amx_StrParam(amx, params[5], mask);
+	return sendQuery(amx, params[1], Data::ListQuery, "", mask ? mask : "", callback, static_cast<int>(params[3]), static_cast<int>(params[4]));
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_QueryMode(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(4, "IRC_QueryMode");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *channel = NULL;
+	amx_StrParam(amx, params[2], channel);
+	if (channel == NULL)
+	{
+		return 0;
+	}
+	char *callback = NULL;
+	amx_StrParam(amx, params[3], callback);
+	if (callback == NULL)
+	{
+		return 0;
+	}
+	char *listMode = NULL;
+	amx_StrParam(amx, params[4], listMode);
+	return sendQuery(amx, params[1], Data::ModeQuery, channel, listMode ? listMode : "", callback);
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetResultRows(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(1, "IRC_GetResultRows");
+	boost::mutex::scoped_lock lock(core->mutex);
+	std::map<int, Data::Query>::iterator q = core->queryResults.find(static_cast<int>(params[1]));
+	if (q != core->queryResults.end())
+	{
+		return static_cast<cell>(q->second.rows.size());
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetResultNumeric(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_GetResultNumeric");
+	boost::mutex::scoped_lock lock(core->mutex);
+	Data::QueryRow *row = getQueryRow(params[1], params[2]);
+	if (row != NULL)
+	{
+		return static_cast<cell>(row->numeric);
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetResultFields(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_GetResultFields");
+	boost::mutex::scoped_lock lock(core->mutex);
+	Data::QueryRow *row = getQueryRow(params[1], params[2]);
+	if (row != NULL)
+	{
+		return static_cast<cell>(row->fields.size());
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_GetResultField(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(5, "IRC_GetResultField");
+	boost::mutex::scoped_lock lock(core->mutex);
+	Data::QueryRow *row = getQueryRow(params[1], params[2]);
+	if (row == NULL || params[3] < 0 || static_cast<std::size_t>(params[3]) >= row->fields.size())
+	{
+		return 0;
+	}
+	cell *destination = NULL;
+	if (!amx_GetAddr(amx, params[4], &destination))
+	{
+		amx_SetString(destination, row->fields[params[3]].c_str(), 0, 0, static_cast<std::size_t>(params[5]));
+		return 1;
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_KeepResult(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(1, "IRC_KeepResult");
+	boost::mutex::scoped_lock lock(core->mutex);
+	std::map<int, Data::Query>::iterator q = core->queryResults.find(static_cast<int>(params[1]));
+	if (q != core->queryResults.end())
+	{
+		q->second.kept = true;
+		return 1;
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_FreeResult(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(1, "IRC_FreeResult");
+	boost::mutex::scoped_lock lock(core->mutex);
+	if (core->queryResults.erase(static_cast<int>(params[1])))
+	{
+		return 1;
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_ScheduleSay(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(5, "IRC_ScheduleSay");
+	boost::mutex::scoped_lock lock(core->mutex);
+	char *target = NULL;
+	amx_StrParam(amx, params[2], target);
+	if (target == NULL)
+	{
+		return 0;
+	}
+	char *message = NULL;
+	amx_StrParam(amx, params[3], message);
+	if (message == NULL)
+	{
+		return 0;
+	}
+	if (params[4] < 0 || (params[5] && params[5] < SCHEDULE_MIN_INTERVAL) || params[5] < 0)
+	{
+		logprintf("*** IRC_ScheduleSay: Invalid delay or interval supplied (%d, %d)", static_cast<int>(params[4]), static_cast<int>(params[5]));
+		return 0;
+	}
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end())
+	{
+		return static_cast<cell>(c->second->scheduleMessage(target, message, static_cast<int>(params[4]), static_cast<int>(params[5])));
+	}
+	return 0;
+}
+
+cell AMX_NATIVE_CALL Natives::IRC_CancelScheduledSay(AMX *amx, cell *params)
+{
+	CHECK_PARAMS(2, "IRC_CancelScheduledSay");
+	boost::mutex::scoped_lock lock(core->mutex);
+	std::map<int, SharedClient>::iterator c = core->clients.find(static_cast<int>(params[1]));
+	if (c != core->clients.end() && c->second->cancelScheduledMessage(static_cast<int>(params[2])))
+	{
+		return 1;
+	}
+	return 0;
+}
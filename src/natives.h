@@ -36,11 +36,23 @@ namespace Natives
 	cell AMX_NATIVE_CALL IRC_SetMode(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_Say(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_Notice(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_SayMulti(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_NoticeMulti(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_IsUserOnChannel(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_InviteUser(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_KickUser(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_GetUserChannelMode(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_GetChannelUserList(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelUserCount(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelUser(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelUsers(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelTopic(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelTopicInfo(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelModes(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetChannelCreationTime(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetUserHost(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetUserAccount(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_IsUserAway(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_SetChannelTopic(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_RequestCTCP(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_ReplyCTCP(AMX *amx, cell *params);
@@ -52,6 +64,32 @@ namespace Natives
 	cell AMX_NATIVE_CALL IRC_GroupSay(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_GroupNotice(AMX *amx, cell *params);
 	cell AMX_NATIVE_CALL IRC_SetIntData(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_StartCapture(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_StopCapture(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_WriteTrace(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_SetProfiling(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetScriptID(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetSlowCallback(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetCallbackHistogram(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_SetQueueLimits(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetQueueStats(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_SetEventClassLimits(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_SetEventClassWeight(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetEventClassStats(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_Subscribe(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_Unsubscribe(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_Whois(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_Who(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_ListChannels(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_QueryMode(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetResultRows(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetResultNumeric(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetResultFields(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_GetResultField(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_KeepResult(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_FreeResult(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_ScheduleSay(AMX *amx, cell *params);
+	cell AMX_NATIVE_CALL IRC_CancelScheduledSay(AMX *amx, cell *params);
 };
 
 #endif
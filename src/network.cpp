@@ -0,0 +1,472 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "network.h"
+
+#include <algorithm>
+#include <cstring>
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace
+{
+	std::vector<Data::Membership>::iterator findMembership(std::vector<Data::Membership> &memberships, int channelID)
+	{
+		std::vector<Data::Membership>::iterator m = std::lower_bound(memberships.begin(), memberships.end(), Data::Membership(channelID));
+		if (m != memberships.end() && m->channel == channelID)
+		{
+			return m;
+		}
+		return memberships.end();
+	}
+
+	void eraseChannelUser(Data::Channel &channel, const std::string *user)
+	{
+		// Erasing shifts the index of every later member, which scripts paging
+		// through the list detect by the change in generation
+		std::vector<const std::string*>::iterator u = std::find(channel.users.begin(), channel.users.end(), user);
+		if (u != channel.users.end())
+		{
+			channel.users.erase(u);
+			++channel.generation;
+		}
+	}
+}
+
+Network::Network()
+{
+	setRankPrefixes(DEFAULT_PREFIX);
+}
+
+bool Network::addChannelReference(const std::string &channel, int botID)
+{
+	// Returns whether this is the first bot in the channel, which is then the
+	// one responsible for filling in its state
+	std::set<int> &bots = addChannel(channel)->second.bots;
+	bool first = bots.empty();
+	bots.insert(botID);
+	return first;
+}
+
+bool Network::removeChannelReference(const std::string &channel, int botID)
+{
+	ChannelMap::iterator c = channels.find(channel);
+	if (c != channels.end())
+	{
+		c->second.bots.erase(botID);
+		if (c->second.bots.empty())
+		{
+			removeChannelUsers(channel);
+			channelIDs[c->second.id] = channels.end();
+			freeChannelIDs.push_back(c->second.id);
+			channels.erase(c);
+			return true;
+		}
+	}
+	return false;
+}
+
+void Network::addChannelUser(const std::string &channel, const std::string &user, int ranks)
+{
+	ChannelMap::iterator c = addChannel(channel);
+	UserMap::iterator f = users.find(user);
+	if (f == users.end())
+	{
+		f = users.insert(std::make_pair(user, std::vector<Data::Membership>())).first;
+		userInfo.insert(std::make_pair(user, Data::User()));
+		std::map<std::string, Data::DepartedUser>::iterator d = departedUsers.find(user);
+		if (d != departedUsers.end())
+		{
+			departedOrder.erase(d->second.order);
+			departedUsers.erase(d);
+		}
+	}
+	// Memberships are kept sorted by channel ID so they can be searched
+	// without a node per channel
+	std::vector<Data::Membership>::iterator m = std::lower_bound(f->second.begin(), f->second.end(), Data::Membership(c->second.id));
+	if (m != f->second.end() && m->channel == c->second.id)
+	{
+		return;
+	}
+	f->second.insert(m, Data::Membership(c->second.id, ranks));
+	c->second.users.push_back(&f->first);
+}
+
+void Network::removeChannelUser(const std::string &channel, const std::string &user)
+{
+	ChannelMap::iterator c = channels.find(channel);
+	UserMap::iterator f = users.find(user);
+	if (c == channels.end() || f == users.end())
+	{
+		return;
+	}
+	std::vector<Data::Membership>::iterator m = findMembership(f->second, c->second.id);
+	if (m == f->second.end())
+	{
+		return;
+	}
+	f->second.erase(m);
+	eraseChannelUser(c->second, &f->first);
+	if (f->second.empty())
+	{
+		userInfo.erase(user);
+		users.erase(f);
+	}
+}
+
+void Network::removeChannelUsers(const std::string &channel)
+{
+	ChannelMap::iterator c = channels.find(channel);
+	if (c != channels.end())
+	{
+		for (std::vector<const std::string*>::iterator u = c->second.users.begin(); u != c->second.users.end(); ++u)
+		{
+			UserMap::iterator f = users.find(**u);
+			if (f != users.end())
+			{
+				std::vector<Data::Membership>::iterator m = findMembership(f->second, c->second.id);
+				if (m != f->second.end())
+				{
+					f->second.erase(m);
+				}
+				if (f->second.empty())
+				{
+					users.erase(f);
+				}
+			}
+		}
+		c->second.users.clear();
+		++c->second.generation;
+	}
+}
+
+void Network::removeUser(const std::string &user)
+{
+	UserMap::iterator f = users.find(user);
+	if (f != users.end())
+	{
+		for (std::vector<Data::Membership>::iterator m = f->second.begin(); m != f->second.end(); ++m)
+		{
+			eraseChannelUser(channelIDs[m->channel]->second, &f->first);
+		}
+		rememberUser(user, f->second);
+		userInfo.erase(user);
+		users.erase(f);
+	}
+}
+
+void Network::removeUsers(const std::set<std::string> &removedUsers)
+{
+	std::set<int> affectedChannels;
+	std::set<const std::string*> removedNames;
+	std::vector<UserMap::iterator> removedEntries;
+	for (std::set<std::string>::const_iterator r = removedUsers.begin(); r != removedUsers.end(); ++r)
+	{
+		UserMap::iterator f = users.find(*r);
+		if (f != users.end())
+		{
+			for (std::vector<Data::Membership>::iterator m = f->second.begin(); m != f->second.end(); ++m)
+			{
+				affectedChannels.insert(m->channel);
+			}
+			removedNames.insert(&f->first);
+			removedEntries.push_back(f);
+		}
+	}
+	// Compact each channel's member list once rather than searching it for
+	// every departing user
+	for (std::set<int>::iterator a = affectedChannels.begin(); a != affectedChannels.end(); ++a)
+	{
+		++channelIDs[*a]->second.generation;
+		std::vector<const std::string*> &channelUsers = channelIDs[*a]->second.users;
+		std::vector<const std::string*>::iterator end = channelUsers.begin();
+		for (std::vector<const std::string*>::iterator u = channelUsers.begin(); u != channelUsers.end(); ++u)
+		{
+			if (removedNames.find(*u) == removedNames.end())
+			{
+				*end = *u;
+				++end;
+			}
+		}
+		channelUsers.erase(end, channelUsers.end());
+	}
+	for (std::vector<UserMap::iterator>::iterator e = removedEntries.begin(); e != removedEntries.end(); ++e)
+	{
+		rememberUser((*e)->first, (*e)->second);
+		userInfo.erase((*e)->first);
+		users.erase(*e);
+	}
+}
+
+void Network::renameUser(const std::string &oldUser, const std::string &newUser)
+{
+	UserMap::iterator f = users.find(oldUser);
+	if (f != users.end() && oldUser != newUser)
+	{
+		UserMap::iterator g = users.find(newUser);
+		if (g != users.end())
+		{
+			// The server only lets a user take a free nick, so an entry already
+			// under it is stale (left by a missed QUIT) and is dropped first
+			for (std::vector<Data::Membership>::iterator m = g->second.begin(); m != g->second.end(); ++m)
+			{
+				eraseChannelUser(channelIDs[m->channel]->second, &g->first);
+			}
+			users.erase(g);
+		}
+		g = users.insert(std::make_pair(newUser, f->second)).first;
+		for (std::vector<Data::Membership>::iterator m = f->second.begin(); m != f->second.end(); ++m)
+		{
+			std::vector<const std::string*> &channelUsers = channelIDs[m->channel]->second.users;
+			std::replace(channelUsers.begin(), channelUsers.end(), &f->first, &g->first);
+		}
+		rememberUser(oldUser, f->second);
+		users.erase(f);
+		UserInfoMap::iterator h = userInfo.find(oldUser);
+		if (h != userInfo.end())
+		{
+			userInfo[newUser] = h->second;
+			userInfo.erase(oldUser);
+		}
+	}
+}
+
+const Data::Membership *Network::getMembership(const std::string &channel, const std::string &user)
+{
+	ChannelMap::iterator c = channels.find(channel);
+	if (c != channels.end())
+	{
+		return getMembership(c->second.id, user);
+	}
+	return NULL;
+}
+
+const Data::Membership *Network::getMembership(int channelID, const std::string &user)
+{
+	UserMap::iterator f = users.find(user);
+	if (f != users.end())
+	{
+		std::vector<Data::Membership>::iterator m = findMembership(f->second, channelID);
+		if (m != f->second.end())
+		{
+			return &*m;
+		}
+	}
+	return NULL;
+}
+
+int Network::getChannelWriter(const std::string &channel)
+{
+	// Bots read their sockets at their own pace, so if each applied what it
+	// read, a bot running behind would replay old lines over newer state. Only
+	// the bot with the lowest ID in a channel changes it; the others read.
+	ChannelMap::iterator c = channels.find(channel);
+	if (c == channels.end() || c->second.bots.empty())
+	{
+		return 0;
+	}
+	return *c->second.bots.begin();
+}
+
+int Network::getUserWriter(const std::string &user)
+{
+	// QUIT and NICK touch every channel a user is in, so they are applied by
+	// the lowest-ID bot in any of them, which sees them like the others do
+	int writer = 0;
+	UserMap::iterator f = users.find(user);
+	if (f != users.end())
+	{
+		for (std::vector<Data::Membership>::iterator m = f->second.begin(); m != f->second.end(); ++m)
+		{
+			std::set<int> &bots = channelIDs[m->channel]->second.bots;
+			if (!bots.empty() && (!writer || *bots.begin() < writer))
+			{
+				writer = *bots.begin();
+			}
+		}
+	}
+	return writer;
+}
+
+std::vector<std::string> Network::getUserChannels(const std::string &user)
+{
+	// The first bot to see a QUIT or NICK removes the user, so the others
+	// look up where the user was in the users who have recently left
+	std::vector<std::string> userChannels;
+	UserMap::iterator f = users.find(user);
+	if (f == users.end())
+	{
+		std::map<std::string, Data::DepartedUser>::iterator d = departedUsers.find(user);
+		if (d != departedUsers.end())
+		{
+			userChannels = d->second.channels;
+		}
+		return userChannels;
+	}
+	for (std::vector<Data::Membership>::iterator m = f->second.begin(); m != f->second.end(); ++m)
+	{
+		userChannels.push_back(channelIDs[m->channel]->first);
+	}
+	return userChannels;
+}
+
+void Network::pruneUserInfo()
+{
+	UserInfoMap::iterator u = userInfo.begin();
+	while (u != userInfo.end())
+	{
+		if (users.find(u->first) == users.end())
+		{
+			userInfo.erase(u++);
+		}
+		else
+		{
+			++u;
+		}
+	}
+}
+
+void Network::updateUserHost(const std::string &user, const std::string &host)
+{
+	UserInfoMap::iterator u = userInfo.find(user);
+	if (u != userInfo.end())
+	{
+		std::size_t locationOfHost = host.find('@');
+		if (locationOfHost != std::string::npos)
+		{
+			u->second.ident = host.substr(0, locationOfHost);
+			u->second.host = host.substr(locationOfHost + 1);
+		}
+	}
+}
+
+std::string Network::getRankPrefix(int ranks)
+{
+	for (std::size_t i = 0; i < rankPrefixes.length(); ++i)
+	{
+		if (ranks & (1 << i))
+		{
+			return std::string(1, rankPrefixes.at(i));
+		}
+	}
+	return std::string();
+}
+
+void Network::setRankPrefixes(const std::string &prefix)
+{
+	// ISUPPORT PREFIX pairs the modes with their prefixes from the highest
+	// rank down, as in "(qaohv)~&@%+"; each rank is one bit in that order
+	std::size_t locationOfEnd = prefix.find(')');
+	if (prefix.find('(') != 0 || locationOfEnd == std::string::npos)
+	{
+		return;
+	}
+	std::size_t count = std::min(std::min(locationOfEnd - 1, prefix.length() - locationOfEnd - 1), static_cast<std::size_t>(MAX_RANKS));
+	rankModes = prefix.substr(1, count);
+	rankPrefixes = prefix.substr(locationOfEnd + 1, count);
+}
+
+void Network::setUserRank(int channelID, const std::string &user, char mode, bool adding)
+{
+	std::size_t rank = rankModes.find(mode);
+	UserMap::iterator f = users.find(user);
+	if (rank == std::string::npos || f == users.end())
+	{
+		return;
+	}
+	std::vector<Data::Membership>::iterator m = findMembership(f->second, channelID);
+	if (m != f->second.end())
+	{
+		if (adding)
+		{
+			m->ranks |= 1 << rank;
+		}
+		else
+		{
+			m->ranks &= ~(1 << rank);
+		}
+	}
+}
+
+int Network::stripRanks(std::string &user)
+{
+	// NAMES lists every prefix a member holds with multi-prefix, or only the
+	// highest without it
+	int ranks = 0;
+	std::size_t length = 0;
+	while (length < user.length())
+	{
+		std::size_t rank = rankPrefixes.find(user.at(length));
+		if (rank == std::string::npos)
+		{
+			break;
+		}
+		ranks |= 1 << rank;
+		++length;
+	}
+	user.erase(0, length);
+	return ranks;
+}
+
+ChannelMap::iterator Network::addChannel(const std::string &channel)
+{
+	ChannelMap::iterator c = channels.find(channel);
+	if (c == channels.end())
+	{
+		c = channels.insert(std::make_pair(channel, Data::Channel())).first;
+		if (freeChannelIDs.empty())
+		{
+			c->second.id = static_cast<int>(channelIDs.size());
+			channelIDs.push_back(c);
+		}
+		else
+		{
+			c->second.id = freeChannelIDs.back();
+			freeChannelIDs.pop_back();
+			channelIDs[c->second.id] = c;
+		}
+	}
+	return c;
+}
+
+void Network::rememberUser(const std::string &user, const std::vector<Data::Membership> &memberships)
+{
+	// Forget the users who left longest ago first, so that the bots still
+	// behind in a QUIT storm or a large netsplit keep what they need
+	std::map<std::string, Data::DepartedUser>::iterator d = departedUsers.find(user);
+	if (d != departedUsers.end())
+	{
+		departedOrder.erase(d->second.order);
+	}
+	else
+	{
+		if (departedUsers.size() >= MAX_DEPARTED_USERS)
+		{
+			departedUsers.erase(departedOrder.front());
+			departedOrder.pop_front();
+		}
+		d = departedUsers.insert(std::make_pair(user, Data::DepartedUser())).first;
+	}
+	d->second.order = departedOrder.insert(departedOrder.end(), user);
+	d->second.channels.clear();
+	for (std::vector<Data::Membership>::const_iterator m = memberships.begin(); m != memberships.end(); ++m)
+	{
+		d->second.channels.push_back(channelIDs[m->channel]->first);
+	}
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef NETWORK_H
+#define NETWORK_H
+
+#define DEFAULT_PREFIX "(ov)@+"
+#define MAX_DEPARTED_USERS (4096)
+#define MAX_RANKS (8)
+
+#include "common.h"
+
+#include <list>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+class Network
+{
+public:
+	Network();
+
+	bool addChannelReference(const std::string &channel, int botID);
+	bool removeChannelReference(const std::string &channel, int botID);
+
+	void addChannelUser(const std::string &channel, const std::string &user, int ranks);
+	void removeChannelUser(const std::string &channel, const std::string &user);
+	void removeChannelUsers(const std::string &channel);
+	void removeUser(const std::string &user);
+	void removeUsers(const std::set<std::string> &removedUsers);
+	void renameUser(const std::string &oldUser, const std::string &newUser);
+	void setUserRank(int channelID, const std::string &user, char mode, bool adding);
+
+	int getChannelWriter(const std::string &channel);
+	int getUserWriter(const std::string &user);
+
+	const Data::Membership *getMembership(const std::string &channel, const std::string &user);
+	const Data::Membership *getMembership(int channelID, const std::string &user);
+	std::vector<std::string> getUserChannels(const std::string &user);
+	void pruneUserInfo();
+	void updateUserHost(const std::string &user, const std::string &host);
+
+	std::string getRankPrefix(int ranks);
+	void setRankPrefixes(const std::string &prefix);
+	int stripRanks(std::string &user);
+
+	ChannelMap channels;
+	UserInfoMap userInfo;
+	UserMap users;
+private:
+	ChannelMap::iterator addChannel(const std::string &channel);
+	void rememberUser(const std::string &user, const std::vector<Data::Membership> &memberships);
+
+	std::vector<ChannelMap::iterator> channelIDs;
+	std::list<std::string> departedOrder;
+	std::map<std::string, Data::DepartedUser> departedUsers;
+	std::vector<int> freeChannelIDs;
+	std::string rankModes;
+	std::string rankPrefixes;
+};
+
+#endif
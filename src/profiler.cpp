@@ -0,0 +1,166 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "profiler.h"
+
+#include "main.h"
+
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/cstdint.hpp>
+
+#include <sdk/plugin.h>
+
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+
+// Callback execution times are kept per script and per callback as a call
+// count, a total, a maximum, and a histogram whose buckets double in width:
+// bucket n counts calls that took from 2^n up to 2^(n + 1) microseconds, with
+// the first bucket also taking anything faster and the last anything slower.
+
+namespace
+{
+	struct RankedCallback
+	{
+		const std::string *callback;
+		const Data::CallbackProfile *profile;
+		int scriptID;
+	};
+
+	bool isSlower(const RankedCallback &first, const RankedCallback &second)
+	{
+		// Ties are broken by script and callback so that every rank refers to
+		// the same callback from one query to the next
+		if (first.profile->totalTime != second.profile->totalTime)
+		{
+			return first.profile->totalTime > second.profile->totalTime;
+		}
+		if (first.scriptID != second.scriptID)
+		{
+			return first.scriptID < second.scriptID;
+		}
+		return *first.callback < *second.callback;
+	}
+}
+
+Profiler::Profiler() : nextScriptID(0), running(false), slowThreshold(0)
+{
+}
+
+void Profiler::addScript(AMX *amx)
+{
+	scriptIDs[amx] = nextScriptID++;
+}
+
+void Profiler::removeScript(AMX *amx)
+{
+	// Statistics are kept under the script's ID, so they survive the script
+	// being unloaded even if its AMX address is reused
+	scriptIDs.erase(amx);
+}
+
+int Profiler::getScriptID(AMX *amx)
+{
+	std::map<AMX*, int>::iterator s = scriptIDs.find(amx);
+	if (s != scriptIDs.end())
+	{
+		return s->second;
+	}
+	return -1;
+}
+
+void Profiler::start(int threshold)
+{
+	profiles.clear();
+	running = true;
+	slowThreshold = threshold;
+}
+
+void Profiler::stop()
+{
+	running = false;
+}
+
+bool Profiler::isRunning()
+{
+	return running;
+}
+
+boost::uint64_t Profiler::now()
+{
+	return static_cast<boost::uint64_t>(boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Profiler::record(AMX *amx, const char *callback, int botID, boost::uint64_t elapsed)
+{
+	int scriptID = getScriptID(amx);
+	Data::CallbackProfile &profile = profiles[scriptID][callback];
+	if (profile.histogram.empty())
+	{
+		profile.histogram.resize(PROFILER_BUCKETS);
+	}
+	++profile.calls;
+	profile.totalTime += elapsed;
+	profile.maxTime = std::max(profile.maxTime, elapsed);
+	std::size_t bucket = 0;
+	while (bucket + 1 < PROFILER_BUCKETS && (elapsed >> (bucket + 1)))
+	{
+		++bucket;
+	}
+	++profile.histogram[bucket];
+	if (slowThreshold > 0 && elapsed >= static_cast<boost::uint64_t>(slowThreshold))
+	{
+		logprintf("*** %s: Callback took %.3f ms in script %d (bot ID %d)", callback, static_cast<double>(elapsed) / 1000.0, scriptID, botID);
+	}
+}
+
+bool Profiler::getSlowCallback(std::size_t rank, int &scriptID, std::string &callback, Data::CallbackProfile &profile)
+{
+	std::vector<RankedCallback> ranking;
+	for (std::map<int, std::map<std::string, Data::CallbackProfile> >::iterator p = profiles.begin(); p != profiles.end(); ++p)
+	{
+		for (std::map<std::string, Data::CallbackProfile>::iterator c = p->second.begin(); c != p->second.end(); ++c)
+		{
+			RankedCallback rankedCallback = { &c->first, &c->second, p->first };
+			ranking.push_back(rankedCallback);
+		}
+	}
+	if (rank >= ranking.size())
+	{
+		return false;
+	}
+	std::sort(ranking.begin(), ranking.end(), isSlower);
+	scriptID = ranking[rank].scriptID;
+	callback = *ranking[rank].callback;
+	profile = *ranking[rank].profile;
+	return true;
+}
+
+Data::CallbackProfile *Profiler::getCallbackProfile(int scriptID, const std::string &callback)
+{
+	std::map<int, std::map<std::string, Data::CallbackProfile> >::iterator p = profiles.find(scriptID);
+	if (p != profiles.end())
+	{
+		std::map<std::string, Data::CallbackProfile>::iterator c = p->second.find(callback);
+		if (c != p->second.end())
+		{
+			return &c->second;
+		}
+	}
+	return NULL;
+}
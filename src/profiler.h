@@ -0,0 +1,57 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#define PROFILER_BUCKETS (16)
+
+#include "data.h"
+
+#include <boost/cstdint.hpp>
+
+#include <sdk/plugin.h>
+
+#include <map>
+#include <string>
+
+class Profiler
+{
+public:
+	Profiler();
+
+	void addScript(AMX *amx);
+	void removeScript(AMX *amx);
+	int getScriptID(AMX *amx);
+
+	void start(int threshold);
+	void stop();
+	bool isRunning();
+
+	boost::uint64_t now();
+	void record(AMX *amx, const char *callback, int botID, boost::uint64_t elapsed);
+
+	bool getSlowCallback(std::size_t rank, int &scriptID, std::string &callback, Data::CallbackProfile &profile);
+	Data::CallbackProfile *getCallbackProfile(int scriptID, const std::string &callback);
+private:
+	int nextScriptID;
+	std::map<int, std::map<std::string, Data::CallbackProfile> > profiles;
+	bool running;
+	std::map<AMX*, int> scriptIDs;
+	int slowThreshold;
+};
+
+#endif
@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "router.h"
+
+#include "data.h"
+
+#include <boost/algorithm/string.hpp>
+
+#include <sdk/plugin.h>
+
+#include <algorithm>
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Routes are keyed by bot ID and lowercase channel name, where ROUTER_ALL_BOTS
+// matches every bot and an empty channel matches every event of the bot,
+// including those not tied to a channel. Scripts without any routes keep
+// receiving every event.
+
+bool Router::addRoute(AMX *amx, int botID, const std::string &channel, unsigned int callbacks)
+{
+	std::pair<std::map<AMX*, unsigned int>::iterator, bool> result = routes[std::make_pair(botID, boost::algorithm::to_lower_copy(channel))].insert(std::make_pair(amx, callbacks));
+	if (!result.second)
+	{
+		result.first->second |= callbacks;
+		return false;
+	}
+	++subscribedScripts[amx];
+	return true;
+}
+
+bool Router::removeRoute(AMX *amx, int botID, const std::string &channel)
+{
+	RouteMap::iterator r = routes.find(std::make_pair(botID, boost::algorithm::to_lower_copy(channel)));
+	if (r == routes.end() || !r->second.erase(amx))
+	{
+		return false;
+	}
+	if (r->second.empty())
+	{
+		routes.erase(r);
+	}
+	std::map<AMX*, std::size_t>::iterator s = subscribedScripts.find(amx);
+	if (!--s->second)
+	{
+		subscribedScripts.erase(s);
+	}
+	return true;
+}
+
+void Router::removeScript(AMX *amx)
+{
+	if (!subscribedScripts.erase(amx))
+	{
+		return;
+	}
+	RouteMap::iterator r = routes.begin();
+	while (r != routes.end())
+	{
+		r->second.erase(amx);
+		if (r->second.empty())
+		{
+			routes.erase(r++);
+		}
+		else
+		{
+			++r;
+		}
+	}
+}
+
+void Router::getTargets(const Data::Message &message, const std::set<AMX*> &interfaces, std::vector<AMX*> &targets) const
+{
+	targets.clear();
+	if (subscribedScripts.empty())
+	{
+		targets.assign(interfaces.begin(), interfaces.end());
+		return;
+	}
+	for (std::set<AMX*>::const_iterator a = interfaces.begin(); a != interfaces.end(); ++a)
+	{
+		if (subscribedScripts.find(*a) == subscribedScripts.end())
+		{
+			targets.push_back(*a);
+		}
+	}
+	int botID = getBotID(message);
+	unsigned int callback = 1U << message.array.at(0);
+	addTargets(routes.find(std::make_pair(botID, std::string())), callback, targets);
+	addTargets(routes.find(std::make_pair(ROUTER_ALL_BOTS, std::string())), callback, targets);
+	const std::string *channel = getChannel(message);
+	if (channel)
+	{
+		std::string lowercaseChannel = boost::algorithm::to_lower_copy(*channel);
+		addTargets(routes.find(std::make_pair(botID, lowercaseChannel)), callback, targets);
+		addTargets(routes.find(std::make_pair(ROUTER_ALL_BOTS, lowercaseChannel)), callback, targets);
+	}
+	// Scripts are called in the same order as they would be by a broadcast,
+	// and only once even if several of their routes match
+	std::sort(targets.begin(), targets.end());
+	targets.erase(std::unique(targets.begin(), targets.end()), targets.end());
+}
+
+int Router::getBotID(const Data::Message &message)
+{
+	switch (message.array.at(0))
+	{
+		case Data::OnConnect:
+		case Data::OnDisconnect:
+		case Data::OnConnectAttempt:
+		case Data::OnConnectAttemptFail:
+		case Data::OnReceiveNumeric:
+		{
+			return message.array.at(2);
+		}
+	}
+	return message.array.at(1);
+}
+
+const std::string *Router::getChannel(const Data::Message &message)
+{
+	// Channel events carry the channel (or, for messages and notices, the
+	// recipient) as the first string parameter, which is pushed last
+	switch (message.array.at(0))
+	{
+		case Data::OnJoinChannel:
+		case Data::OnLeaveChannel:
+		case Data::OnInvitedToChannel:
+		case Data::OnKickedFromChannel:
+		case Data::OnUserJoinChannel:
+		case Data::OnUserLeaveChannel:
+		case Data::OnUserKickedFromChannel:
+		case Data::OnUserSetChannelMode:
+		case Data::OnUserSetChannelTopic:
+		case Data::OnUserSay:
+		case Data::OnUserNotice:
+		{
+			return &message.buffer.back();
+		}
+	}
+	return NULL;
+}
+
+void Router::addTargets(RouteMap::const_iterator r, unsigned int callback, std::vector<AMX*> &targets) const
+{
+	if (r == routes.end())
+	{
+		return;
+	}
+	for (std::map<AMX*, unsigned int>::const_iterator a = r->second.begin(); a != r->second.end(); ++a)
+	{
+		if (a->second & callback)
+		{
+			targets.push_back(a->first);
+		}
+	}
+}
@@ -0,0 +1,52 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROUTER_H
+#define ROUTER_H
+
+#define ROUTER_ALL_BOTS (0)
+
+#include "data.h"
+
+#include <sdk/plugin.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+class Router
+{
+public:
+	bool addRoute(AMX *amx, int botID, const std::string &channel, unsigned int callbacks);
+	bool removeRoute(AMX *amx, int botID, const std::string &channel);
+	void removeScript(AMX *amx);
+
+	void getTargets(const Data::Message &message, const std::set<AMX*> &interfaces, std::vector<AMX*> &targets) const;
+
+	static int getBotID(const Data::Message &message);
+	static const std::string *getChannel(const Data::Message &message);
+private:
+	typedef std::map<std::pair<int, std::string>, std::map<AMX*, unsigned int> > RouteMap;
+
+	void addTargets(RouteMap::const_iterator r, unsigned int callback, std::vector<AMX*> &targets) const;
+
+	RouteMap routes;
+	std::map<AMX*, std::size_t> subscribedScripts;
+};
+
+#endif
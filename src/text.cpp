@@ -0,0 +1,491 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "text.h"
+
+#include <boost/cstdint.hpp>
+
+#include <algorithm>
+#include <cstring>
+#include <string>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TEXT_SSE2
+#include <emmintrin.h>
+#endif
+
+// Unicode code points for bytes 0x80 to 0xFF. Bytes the code page leaves
+// undefined map to the C1 control with the same value so they round-trip.
+
+static const boost::uint16_t windows1251[128] =
+{
+	0x0402, 0x0403, 0x201A, 0x0453, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x20AC, 0x2030, 0x0409, 0x2039, 0x040A, 0x040C, 0x040B, 0x040F,
+	0x0452, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x0098, 0x2122, 0x0459, 0x203A, 0x045A, 0x045C, 0x045B, 0x045F,
+	0x00A0, 0x040E, 0x045E, 0x0408, 0x00A4, 0x0490, 0x00A6, 0x00A7,
+	0x0401, 0x00A9, 0x0404, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x0407,
+	0x00B0, 0x00B1, 0x0406, 0x0456, 0x0491, 0x00B5, 0x00B6, 0x00B7,
+	0x0451, 0x2116, 0x0454, 0x00BB, 0x0458, 0x0405, 0x0455, 0x0457,
+	0x0410, 0x0411, 0x0412, 0x0413, 0x0414, 0x0415, 0x0416, 0x0417,
+	0x0418, 0x0419, 0x041A, 0x041B, 0x041C, 0x041D, 0x041E, 0x041F,
+	0x0420, 0x0421, 0x0422, 0x0423, 0x0424, 0x0425, 0x0426, 0x0427,
+	0x0428, 0x0429, 0x042A, 0x042B, 0x042C, 0x042D, 0x042E, 0x042F,
+	0x0430, 0x0431, 0x0432, 0x0433, 0x0434, 0x0435, 0x0436, 0x0437,
+	0x0438, 0x0439, 0x043A, 0x043B, 0x043C, 0x043D, 0x043E, 0x043F,
+	0x0440, 0x0441, 0x0442, 0x0443, 0x0444, 0x0445, 0x0446, 0x0447,
+	0x0448, 0x0449, 0x044A, 0x044B, 0x044C, 0x044D, 0x044E, 0x044F
+};
+
+static const boost::uint16_t windows1252[128] =
+{
+	0x20AC, 0x0081, 0x201A, 0x0192, 0x201E, 0x2026, 0x2020, 0x2021,
+	0x02C6, 0x2030, 0x0160, 0x2039, 0x0152, 0x008D, 0x017D, 0x008F,
+	0x0090, 0x2018, 0x2019, 0x201C, 0x201D, 0x2022, 0x2013, 0x2014,
+	0x02DC, 0x2122, 0x0161, 0x203A, 0x0153, 0x009D, 0x017E, 0x0178,
+	0x00A0, 0x00A1, 0x00A2, 0x00A3, 0x00A4, 0x00A5, 0x00A6, 0x00A7,
+	0x00A8, 0x00A9, 0x00AA, 0x00AB, 0x00AC, 0x00AD, 0x00AE, 0x00AF,
+	0x00B0, 0x00B1, 0x00B2, 0x00B3, 0x00B4, 0x00B5, 0x00B6, 0x00B7,
+	0x00B8, 0x00B9, 0x00BA, 0x00BB, 0x00BC, 0x00BD, 0x00BE, 0x00BF,
+	0x00C0, 0x00C1, 0x00C2, 0x00C3, 0x00C4, 0x00C5, 0x00C6, 0x00C7,
+	0x00C8, 0x00C9, 0x00CA, 0x00CB, 0x00CC, 0x00CD, 0x00CE, 0x00CF,
+	0x00D0, 0x00D1, 0x00D2, 0x00D3, 0x00D4, 0x00D5, 0x00D6, 0x00D7,
+	0x00D8, 0x00D9, 0x00DA, 0x00DB, 0x00DC, 0x00DD, 0x00DE, 0x00DF,
+	0x00E0, 0x00E1, 0x00E2, 0x00E3, 0x00E4, 0x00E5, 0x00E6, 0x00E7,
+	0x00E8, 0x00E9, 0x00EA, 0x00EB, 0x00EC, 0x00ED, 0x00EE, 0x00EF,
+	0x00F0, 0x00F1, 0x00F2, 0x00F3, 0x00F4, 0x00F5, 0x00F6, 0x00F7,
+	0x00F8, 0x00F9, 0x00FA, 0x00FB, 0x00FC, 0x00FD, 0x00FE, 0x00FF
+};
+
+struct ReverseEntry
+{
+	boost::uint16_t codePoint;
+	unsigned char byte;
+
+	bool operator<(const ReverseEntry &entry) const
+	{
+		return codePoint < entry.codePoint;
+	}
+};
+
+// Code point to byte lookups, sorted by code point and searched with a binary
+// search; built once when the plugin is loaded
+
+class ReverseTable
+{
+public:
+	ReverseTable(const boost::uint16_t *table)
+	{
+		for (std::size_t i = 0; i < 128; ++i)
+		{
+			entries[i].codePoint = table[i];
+			entries[i].byte = static_cast<unsigned char>(i + 0x80);
+		}
+		std::sort(entries, entries + 128);
+	}
+
+	char find(boost::uint32_t codePoint) const
+	{
+		ReverseEntry entry;
+		entry.codePoint = static_cast<boost::uint16_t>(codePoint);
+		const ReverseEntry *f = std::lower_bound(entries, entries + 128, entry);
+		if (codePoint <= 0xFFFF && f != entries + 128 && f->codePoint == codePoint)
+		{
+			return static_cast<char>(f->byte);
+		}
+		return '?';
+	}
+private:
+	ReverseEntry entries[128];
+};
+
+static const ReverseTable reverseWindows1251(windows1251);
+static const ReverseTable reverseWindows1252(windows1252);
+
+// SA-MP colour embeddings for the 16 standard mIRC colours
+
+static const char *mircColors[16] =
+{
+	"{FFFFFF}", "{000000}", "{00007F}", "{009300}", "{FF0000}", "{7F0000}", "{9C009C}", "{FC7F00}",
+	"{FFFF00}", "{00FC00}", "{009393}", "{00FFFF}", "{0000FC}", "{FF00FF}", "{7F7F7F}", "{D2D2D2}"
+};
+
+enum FormattingCodes
+{
+	Bold = 0x02,
+	Color = 0x03,
+	HexColor = 0x04,
+	Reset = 0x0F,
+	Monospace = 0x11,
+	Reverse = 0x16,
+	Italic = 0x1D,
+	Strikethrough = 0x1E,
+	Underline = 0x1F
+};
+
+static bool isHexDigit(char character)
+{
+	return (character >= '0' && character <= '9') || (character >= 'A' && character <= 'F') || (character >= 'a' && character <= 'f');
+}
+
+static void copyASCII(const unsigned char *data, std::size_t length, std::size_t &i, char *&end)
+{
+	// Short runs between non-ASCII characters are cheaper to copy a byte at a
+	// time than to hand to the block scan
+	if (i + 16 <= length && data[i + 1] < 0x80 && data[i + 2] < 0x80 && data[i + 3] < 0x80)
+	{
+		std::size_t run = Text::findNonASCII(reinterpret_cast<const char*>(data) + i, length - i);
+		std::memcpy(end, data + i, run);
+		end += run;
+		i += run;
+	}
+	else
+	{
+		*end++ = static_cast<char>(data[i]);
+		++i;
+	}
+}
+
+static std::string convertFormatting(const std::string &input, bool translate)
+{
+	std::size_t length = input.length(), i = Text::findControl(input.data(), length);
+	if (i == length)
+	{
+		return input;
+	}
+	const char *data = input.data();
+	std::string output;
+	output.reserve(length + 16);
+	output.append(data, i);
+	bool colored = false;
+	while (i < length)
+	{
+		switch (data[i])
+		{
+			case Bold:
+			case Monospace:
+			case Reverse:
+			case Italic:
+			case Strikethrough:
+			case Underline:
+			{
+				++i;
+				break;
+			}
+			case Reset:
+			{
+				if (translate && colored)
+				{
+					output.append("{FFFFFF}");
+					colored = false;
+				}
+				++i;
+				break;
+			}
+			case Color:
+			{
+				// \x03 is followed by up to two digits for the foreground and,
+				// after a comma, up to two more for the background
+				int foreground = -1;
+				std::size_t j = i + 1;
+				if (j < length && data[j] >= '0' && data[j] <= '9')
+				{
+					foreground = data[j++] - '0';
+					if (j < length && data[j] >= '0' && data[j] <= '9')
+					{
+						foreground = foreground * 10 + data[j++] - '0';
+					}
+					if (j + 1 < length && data[j] == ',' && data[j + 1] >= '0' && data[j + 1] <= '9')
+					{
+						j += 2;
+						if (j < length && data[j] >= '0' && data[j] <= '9')
+						{
+							++j;
+						}
+					}
+				}
+				if (translate)
+				{
+					if (foreground >= 0 && foreground < 16)
+					{
+						output.append(mircColors[foreground]);
+						colored = true;
+					}
+					else if (foreground < 0 && colored)
+					{
+						output.append("{FFFFFF}");
+						colored = false;
+					}
+				}
+				i = j;
+				break;
+			}
+			case HexColor:
+			{
+				std::size_t j = i + 1, digits = 0;
+				while (digits < 6 && j + digits < length && isHexDigit(data[j + digits]))
+				{
+					++digits;
+				}
+				if (digits == 6)
+				{
+					if (translate)
+					{
+						output.append("{").append(data + j, 6).append("}");
+						colored = true;
+					}
+					j += 6;
+					if (j + 6 < length && data[j] == ',')
+					{
+						std::size_t k = 0;
+						while (k < 6 && isHexDigit(data[j + 1 + k]))
+						{
+							++k;
+						}
+						if (k == 6)
+						{
+							j += 7;
+						}
+					}
+				}
+				else if (translate && colored)
+				{
+					output.append("{FFFFFF}");
+					colored = false;
+				}
+				i = j;
+				break;
+			}
+			default:
+			{
+				output += data[i++];
+				break;
+			}
+		}
+		std::size_t run = Text::findControl(data + i, length - i);
+		output.append(data + i, run);
+		i += run;
+	}
+	return output;
+}
+
+std::size_t Text::findControl(const char *data, std::size_t length)
+{
+	std::size_t i = 0;
+#ifdef TEXT_SSE2
+	// A byte is a control character when max(byte, 0x1F) == 0x1F
+	const __m128i limit = _mm_set1_epi8(0x1F);
+	for (; i + 32 <= length; i += 32)
+	{
+		__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+		__m128i controls = _mm_or_si128(_mm_cmpeq_epi8(_mm_max_epu8(first, limit), limit), _mm_cmpeq_epi8(_mm_max_epu8(second, limit), limit));
+		if (_mm_movemask_epi8(controls))
+		{
+			break;
+		}
+	}
+	for (; i + 16 <= length; i += 16)
+	{
+		__m128i block = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		if (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(block, limit), limit)))
+		{
+			break;
+		}
+	}
+#else
+	// Flags bytes below 0x20 by subtracting 0x20 from every byte and keeping
+	// those that borrowed and did not already have the top bit set
+	for (; i + 16 <= length; i += 16)
+	{
+		boost::uint32_t words[4];
+		std::memcpy(words, data + i, sizeof(words));
+		if (((words[0] - 0x20202020) & ~words[0] & 0x80808080) | ((words[1] - 0x20202020) & ~words[1] & 0x80808080) | ((words[2] - 0x20202020) & ~words[2] & 0x80808080) | ((words[3] - 0x20202020) & ~words[3] & 0x80808080))
+		{
+			break;
+		}
+	}
+#endif
+	for (; i < length; ++i)
+	{
+		if (static_cast<unsigned char>(data[i]) < 0x20)
+		{
+			break;
+		}
+	}
+	return i;
+}
+
+std::size_t Text::findNonASCII(const char *data, std::size_t length)
+{
+	std::size_t i = 0;
+#ifdef TEXT_SSE2
+	for (; i + 32 <= length; i += 32)
+	{
+		__m128i first = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+		__m128i second = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+		if (_mm_movemask_epi8(_mm_or_si128(first, second)))
+		{
+			break;
+		}
+	}
+	for (; i + 16 <= length; i += 16)
+	{
+		if (_mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i))))
+		{
+			break;
+		}
+	}
+#else
+	for (; i + 16 <= length; i += 16)
+	{
+		boost::uint32_t words[4];
+		std::memcpy(words, data + i, sizeof(words));
+		if ((words[0] | words[1] | words[2] | words[3]) & 0x80808080)
+		{
+			break;
+		}
+	}
+#endif
+	for (; i < length; ++i)
+	{
+		if (data[i] & 0x80)
+		{
+			break;
+		}
+	}
+	return i;
+}
+
+std::string Text::fromUTF8(const std::string &input, int charset)
+{
+	std::size_t length = input.length(), i = findNonASCII(input.data(), length);
+	if (i == length || (charset != Windows1251 && charset != Windows1252))
+	{
+		return input;
+	}
+	const ReverseTable &table = charset == Windows1251 ? reverseWindows1251 : reverseWindows1252;
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(input.data());
+	// The output is never longer than the input
+	std::string output(length, '\0');
+	char *begin = &output[0], *end = begin + i;
+	std::memcpy(begin, data, i);
+	while (i < length)
+	{
+		unsigned char byte = data[i];
+		if (byte < 0x80)
+		{
+			copyASCII(data, length, i, end);
+			continue;
+		}
+		std::size_t sequenceLength = 0;
+		boost::uint32_t codePoint = 0;
+		if (byte >= 0xC2 && byte <= 0xDF)
+		{
+			sequenceLength = 2;
+			codePoint = byte & 0x1F;
+		}
+		else if (byte >= 0xE0 && byte <= 0xEF)
+		{
+			sequenceLength = 3;
+			codePoint = byte & 0x0F;
+		}
+		else if (byte >= 0xF0 && byte <= 0xF4)
+		{
+			sequenceLength = 4;
+			codePoint = byte & 0x07;
+		}
+		std::size_t j = 1;
+		for (; j < sequenceLength && i + j < length && (data[i + j] & 0xC0) == 0x80; ++j)
+		{
+			codePoint = (codePoint << 6) | (data[i + j] & 0x3F);
+		}
+		if (sequenceLength && j == sequenceLength)
+		{
+			*end++ = table.find(codePoint);
+			i += sequenceLength;
+		}
+		else
+		{
+			// Not valid UTF-8, so the client most likely sent the code page itself
+			*end++ = static_cast<char>(byte);
+			++i;
+		}
+	}
+	output.resize(end - begin);
+	return output;
+}
+
+std::string Text::stripFormatting(const std::string &input)
+{
+	return convertFormatting(input, false);
+}
+
+std::string Text::translateFormatting(const std::string &input)
+{
+	return convertFormatting(input, true);
+}
+
+void Text::appendUTF8(std::string &output, const char *input, std::size_t length, int charset)
+{
+	std::size_t i = findNonASCII(input, length);
+	if (i == length || (charset != Windows1251 && charset != Windows1252))
+	{
+		output.append(input, length);
+		return;
+	}
+	const boost::uint16_t *table = charset == Windows1251 ? windows1251 : windows1252;
+	const unsigned char *data = reinterpret_cast<const unsigned char*>(input);
+	// Every code point in the tables takes at most three bytes
+	std::size_t offset = output.length();
+	output.resize(offset + i + (length - i) * 3);
+	char *begin = &output[0], *end = begin + offset + i;
+	std::memcpy(begin + offset, data, i);
+	while (i < length)
+	{
+		unsigned char byte = data[i];
+		if (byte < 0x80)
+		{
+			copyASCII(data, length, i, end);
+			continue;
+		}
+		boost::uint16_t codePoint = table[byte - 0x80];
+		if (codePoint < 0x800)
+		{
+			*end++ = static_cast<char>(0xC0 | (codePoint >> 6));
+			*end++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		else
+		{
+			*end++ = static_cast<char>(0xE0 | (codePoint >> 12));
+			*end++ = static_cast<char>(0x80 | ((codePoint >> 6) & 0x3F));
+			*end++ = static_cast<char>(0x80 | (codePoint & 0x3F));
+		}
+		++i;
+	}
+	output.resize(end - begin);
+}
+
+std::string Text::toUTF8(const std::string &input, int charset)
+{
+	if (findNonASCII(input.data(), input.length()) == input.length())
+	{
+		return input;
+	}
+	std::string output;
+	appendUTF8(output, input.data(), input.length(), charset);
+	return output;
+}
@@ -0,0 +1,51 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TEXT_H
+#define TEXT_H
+
+#include <cstddef>
+#include <string>
+
+namespace Text
+{
+	enum Charsets
+	{
+		UTF8,
+		Windows1251,
+		Windows1252
+	};
+
+	enum FormattingModes
+	{
+		KeepFormatting,
+		StripFormatting,
+		TranslateFormatting
+	};
+
+	std::size_t findControl(const char *data, std::size_t length);
+	std::size_t findNonASCII(const char *data, std::size_t length);
+
+	std::string stripFormatting(const std::string &input);
+	std::string translateFormatting(const std::string &input);
+
+	void appendUTF8(std::string &output, const char *data, std::size_t length, int charset);
+
+	std::string fromUTF8(const std::string &input, int charset);
+	std::string toUTF8(const std::string &input, int charset);
+}
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "trace.h"
+
+#ifdef IRC_TRACE
+
+#include <boost/chrono/system_clocks.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/shared_ptr.hpp>
+#include <boost/thread.hpp>
+#include <boost/thread/tss.hpp>
+
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Each thread records spans into its own fixed-size ring buffer, so recording
+// a span never allocates and only takes a lock that is uncontended unless a
+// trace is being written at the same time. Writing a trace merges all buffers
+// into a Chrome trace event file that can be opened in chrome://tracing or
+// Perfetto.
+
+namespace
+{
+	const std::size_t bufferCapacity = 65536;
+
+	struct Event
+	{
+		const char *name;
+		boost::uint64_t begin;
+		boost::uint64_t end;
+	};
+
+	struct Buffer
+	{
+		Buffer(int threadID) : events(bufferCapacity), next(0), threadID(threadID), wrapped(false) {}
+
+		boost::mutex mutex;
+		std::vector<Event> events;
+		std::size_t next;
+		int threadID;
+		bool wrapped;
+	};
+
+	void releaseBuffer(Buffer *buffer)
+	{
+	}
+
+	boost::mutex buffersMutex;
+	std::vector<boost::shared_ptr<Buffer> > buffers;
+	boost::thread_specific_ptr<Buffer> threadBuffer(releaseBuffer);
+
+	Buffer *currentBuffer()
+	{
+		Buffer *buffer = threadBuffer.get();
+		if (!buffer)
+		{
+			boost::mutex::scoped_lock lock(buffersMutex);
+			boost::shared_ptr<Buffer> newBuffer(new Buffer(static_cast<int>(buffers.size()) + 1));
+			buffers.push_back(newBuffer);
+			buffer = newBuffer.get();
+			threadBuffer.reset(buffer);
+		}
+		return buffer;
+	}
+
+	void writeEscaped(std::ofstream &file, const char *string)
+	{
+		for (const char *c = string; *c; ++c)
+		{
+			if (*c == '"' || *c == '\\')
+			{
+				file << '\\';
+			}
+			file << *c;
+		}
+	}
+}
+
+boost::uint64_t Trace::now()
+{
+	return static_cast<boost::uint64_t>(boost::chrono::duration_cast<boost::chrono::microseconds>(boost::chrono::steady_clock::now().time_since_epoch()).count());
+}
+
+void Trace::record(const char *name, boost::uint64_t begin, boost::uint64_t end)
+{
+	Buffer *buffer = currentBuffer();
+	boost::mutex::scoped_lock lock(buffer->mutex);
+	Event &event = buffer->events[buffer->next];
+	event.name = name;
+	event.begin = begin;
+	event.end = end;
+	if (++buffer->next == buffer->events.size())
+	{
+		buffer->next = 0;
+		buffer->wrapped = true;
+	}
+}
+
+bool Trace::write(const std::string &fileName)
+{
+	std::ofstream file(fileName.c_str(), std::ios::out | std::ios::trunc);
+	if (!file.is_open())
+	{
+		return false;
+	}
+	std::vector<boost::shared_ptr<Buffer> > currentBuffers;
+	boost::mutex::scoped_lock lock(buffersMutex);
+	currentBuffers = buffers;
+	lock.unlock();
+	file << "{\"traceEvents\":[";
+	bool first = true;
+	for (std::vector<boost::shared_ptr<Buffer> >::iterator b = currentBuffers.begin(); b != currentBuffers.end(); ++b)
+	{
+		boost::mutex::scoped_lock bufferLock((*b)->mutex);
+		std::vector<Event> events;
+		if ((*b)->wrapped)
+		{
+			events.assign((*b)->events.begin() + (*b)->next, (*b)->events.end());
+		}
+		events.insert(events.end(), (*b)->events.begin(), (*b)->events.begin() + (*b)->next);
+		bufferLock.unlock();
+		for (std::vector<Event>::iterator e = events.begin(); e != events.end(); ++e)
+		{
+			file << (first ? "\n" : ",\n") << "{\"name\":\"";
+			writeEscaped(file, e->name);
+			file << "\",\"cat\":\"irc\",\"ph\":\"X\",\"pid\":1,\"tid\":" << (*b)->threadID << ",\"ts\":" << e->begin << ",\"dur\":" << (e->end - e->begin) << "}";
+			first = false;
+		}
+	}
+	file << "\n],\"displayTimeUnit\":\"ms\"}\n";
+	return file.good();
+}
+
+#endif
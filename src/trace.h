@@ -0,0 +1,72 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#ifdef IRC_TRACE
+
+#include <boost/cstdint.hpp>
+
+#include <string>
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SPAN(name) Trace::Span TRACE_CONCAT(traceSpan, __LINE__)(name)
+#define TRACE_BEGIN(span, name) Trace::Span span(name)
+#define TRACE_END(span) span.end()
+#define TRACE_RECORD(name, begin) Trace::record(name, begin, Trace::now())
+
+namespace Trace
+{
+	boost::uint64_t now();
+	void record(const char *name, boost::uint64_t begin, boost::uint64_t end);
+	bool write(const std::string &fileName);
+
+	class Span
+	{
+	public:
+		Span(const char *name) : name(name), begin(now()), ended(false) {}
+		~Span()
+		{
+			end();
+		}
+
+		void end()
+		{
+			if (!ended)
+			{
+				record(name, begin, now());
+				ended = true;
+			}
+		}
+	private:
+		const char *name;
+		boost::uint64_t begin;
+		bool ended;
+	};
+}
+
+#else
+
+#define TRACE_SPAN(name)
+#define TRACE_BEGIN(span, name)
+#define TRACE_END(span)
+#define TRACE_RECORD(name, begin)
+
+#endif
+
+#endif
@@ -0,0 +1,259 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Micro-benchmarks for the plugin's hot string paths. Each benchmark runs its
+// operation a fixed number of times over representative chat lines and
+// reports the time per operation and the throughput in input bytes. Memory
+// benchmarks then fill a network with synthetic channels and report the heap
+// bytes used per channel membership.
+
+#include "../../src/network.h"
+#include "../../src/text.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+typedef std::size_t (*BenchmarkFunction)(const std::string &input);
+
+struct Benchmark
+{
+	const char *name;
+	BenchmarkFunction function;
+	const std::string *input;
+};
+
+struct MemoryBenchmark
+{
+	const char *name;
+	std::size_t channels;
+	std::size_t channelUsers;
+	std::size_t users;
+};
+
+// Every allocation is prefixed with its size so that the bytes currently in
+// use can be tracked. This counts what was requested, not the allocator's own
+// per-block overhead.
+static std::size_t allocatedBytes = 0;
+
+void *operator new(std::size_t size)
+{
+	std::size_t *block = static_cast<std::size_t*>(std::malloc(size + 2 * sizeof(std::size_t)));
+	if (!block)
+	{
+		throw std::bad_alloc();
+	}
+	block[0] = size;
+	allocatedBytes += size;
+	return block + 2;
+}
+
+void operator delete(void *pointer)
+{
+	if (pointer)
+	{
+		std::size_t *block = static_cast<std::size_t*>(pointer) - 2;
+		allocatedBytes -= block[0];
+		std::free(block);
+	}
+}
+
+static std::string asciiLine, latinLine, cyrillicLine, latinUTF8Line, cyrillicUTF8Line, formattedLine;
+
+static std::size_t findNonASCII(const std::string &input)
+{
+	return Text::findNonASCII(input.data(), input.length());
+}
+
+static std::size_t toUTF8Windows1251(const std::string &input)
+{
+	return Text::toUTF8(input, Text::Windows1251).length();
+}
+
+static std::size_t toUTF8Windows1252(const std::string &input)
+{
+	return Text::toUTF8(input, Text::Windows1252).length();
+}
+
+static std::size_t fromUTF8Windows1251(const std::string &input)
+{
+	return Text::fromUTF8(input, Text::Windows1251).length();
+}
+
+static std::size_t fromUTF8Windows1252(const std::string &input)
+{
+	return Text::fromUTF8(input, Text::Windows1252).length();
+}
+
+static std::size_t stripFormatting(const std::string &input)
+{
+	return Text::stripFormatting(input).length();
+}
+
+static std::size_t translateFormatting(const std::string &input)
+{
+	return Text::translateFormatting(input).length();
+}
+
+static const Benchmark benchmarks[] =
+{
+	{ "findNonASCII/ascii", findNonASCII, &asciiLine },
+	{ "toUTF8/1252/ascii", toUTF8Windows1252, &asciiLine },
+	{ "toUTF8/1252/latin", toUTF8Windows1252, &latinLine },
+	{ "toUTF8/1251/cyrillic", toUTF8Windows1251, &cyrillicLine },
+	{ "fromUTF8/1252/ascii", fromUTF8Windows1252, &asciiLine },
+	{ "fromUTF8/1252/latin", fromUTF8Windows1252, &latinUTF8Line },
+	{ "fromUTF8/1251/cyrillic", fromUTF8Windows1251, &cyrillicUTF8Line },
+	{ "stripFormatting/plain", stripFormatting, &asciiLine },
+	{ "stripFormatting/formatted", stripFormatting, &formattedLine },
+	{ "translateFormatting/plain", translateFormatting, &asciiLine },
+	{ "translateFormatting/formatted", translateFormatting, &formattedLine }
+};
+
+// Each channel has the same number of users, drawn from a shared pool so that
+// users sit in several channels, and every tenth member has a prefix
+static const MemoryBenchmark memoryBenchmarks[] =
+{
+	{ "memberships/1x10000", 1, 10000, 10000 },
+	{ "memberships/10x10000", 10, 10000, 30000 },
+	{ "memberships/50x10000", 50, 10000, 100000 }
+};
+
+static bool isSelected(const char *name, const std::vector<std::string> &filters)
+{
+	if (filters.empty())
+	{
+		return true;
+	}
+	for (std::vector<std::string>::const_iterator f = filters.begin(); f != filters.end(); ++f)
+	{
+		if (std::strstr(name, f->c_str()))
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+static void printUsage(const char *program)
+{
+	std::fprintf(stderr, "Usage: %s [-i iterations] [filter...]\n", program);
+	std::fprintf(stderr, "  -i iterations  Operations per benchmark (default 1000000)\n");
+	std::fprintf(stderr, "  filter         Only run benchmarks whose name contains this text\n");
+}
+
+int main(int argc, char **argv)
+{
+	std::size_t iterations = 1000000;
+	std::vector<std::string> filters;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "-i") && i + 1 < argc)
+		{
+			iterations = static_cast<std::size_t>(std::atol(argv[++i]));
+		}
+		else if (argv[i][0] != '-')
+		{
+			filters.push_back(argv[i]);
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (!iterations)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+	// A typical relayed chat line, and the same line with a quarter of its
+	// letters replaced by accented Latin or by Cyrillic letters
+	asciiLine = "[12] Player_Name: has anyone seen the admin around? need help with the race at LV airport";
+	latinLine = asciiLine;
+	cyrillicLine = asciiLine;
+	for (std::size_t i = 0; i < asciiLine.length(); i += 4)
+	{
+		if (asciiLine[i] != ' ')
+		{
+			latinLine[i] = static_cast<char>(0xE0 + (i % 0x1F));
+			cyrillicLine[i] = static_cast<char>(0xC0 + (i % 0x40));
+		}
+	}
+	latinUTF8Line = Text::toUTF8(latinLine, Text::Windows1252);
+	cyrillicUTF8Line = Text::toUTF8(cyrillicLine, Text::Windows1251);
+	formattedLine = "\x02[12]\x02 \x03" "04,01Player_Name\x03: has anyone seen the \x1F" "admin\x1F around? \x03" "09need help\x0F with the race at LV airport";
+	std::printf("%-28s %12s %12s\n", "Benchmark", "ns/op", "MB/s");
+	std::size_t sink = 0;
+	for (std::size_t b = 0; b < sizeof(benchmarks) / sizeof(Benchmark); ++b)
+	{
+		if (!isSelected(benchmarks[b].name, filters))
+		{
+			continue;
+		}
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		for (std::size_t i = 0; i < iterations; ++i)
+		{
+			sink += benchmarks[b].function(*benchmarks[b].input);
+		}
+		double elapsed = static_cast<double>((boost::posix_time::microsec_clock::universal_time() - start).total_microseconds());
+		double bytes = static_cast<double>(benchmarks[b].input->length()) * static_cast<double>(iterations);
+		std::printf("%-28s %12.1f %12.1f\n", benchmarks[b].name, elapsed * 1000.0 / static_cast<double>(iterations), elapsed > 0.0 ? bytes / elapsed : 0.0);
+	}
+	std::printf("\n%-28s %12s %12s %12s\n", "Benchmark", "memberships", "bytes/each", "ns/insert");
+	for (std::size_t b = 0; b < sizeof(memoryBenchmarks) / sizeof(MemoryBenchmark); ++b)
+	{
+		const MemoryBenchmark &benchmark = memoryBenchmarks[b];
+		if (!isSelected(benchmark.name, filters))
+		{
+			continue;
+		}
+		std::vector<std::string> users(benchmark.users);
+		for (std::size_t i = 0; i < users.size(); ++i)
+		{
+			char nickname[32];
+			std::sprintf(nickname, "Player_%06lu", static_cast<unsigned long>(i));
+			users[i] = nickname;
+		}
+		std::size_t baseBytes = allocatedBytes;
+		Network *network = new Network;
+		std::string op = "@";
+		int opRanks = network->stripRanks(op);
+		boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+		for (std::size_t c = 0; c < benchmark.channels; ++c)
+		{
+			char channel[32];
+			std::sprintf(channel, "#channel%lu", static_cast<unsigned long>(c));
+			network->addChannelReference(channel, 1);
+			for (std::size_t i = 0; i < benchmark.channelUsers; ++i)
+			{
+				network->addChannelUser(channel, users[(c * 7919 + i) % users.size()], i % 10 ? 0 : opRanks);
+			}
+		}
+		double elapsed = static_cast<double>((boost::posix_time::microsec_clock::universal_time() - start).total_microseconds());
+		double memberships = static_cast<double>(benchmark.channels * benchmark.channelUsers);
+		std::printf("%-28s %12.0f %12.1f %12.1f\n", benchmark.name, memberships, static_cast<double>(allocatedBytes - baseBytes) / memberships, elapsed * 1000.0 / memberships);
+		sink += network->users.size();
+		delete network;
+	}
+	return sink == 0;
+}
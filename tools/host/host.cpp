@@ -0,0 +1,827 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Host-side harness that loads the plugin the same way the SA-MP server does
+// and supplies an emulated AMX export table. Each stub script records the
+// callbacks it receives, so callback dispatch cost, native latency and memory
+// use can be measured without a game server. A capture file recorded with
+// IRC_StartCapture can be served to the plugin over a loopback socket to
+// generate realistic event load.
+
+#include "../../src/capture.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/thread.hpp>
+
+#include <sdk/plugin.h>
+
+#include <arpa/inet.h>
+#include <dlfcn.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+#include <vector>
+
+typedef unsigned int (PLUGIN_CALL *Supports_t)();
+typedef bool (PLUGIN_CALL *Load_t)(void **ppData);
+typedef void (PLUGIN_CALL *Unload_t)();
+typedef int (PLUGIN_CALL *AmxLoad_t)(AMX *amx);
+typedef int (PLUGIN_CALL *AmxUnload_t)(AMX *amx);
+typedef void (PLUGIN_CALL *ProcessTick_t)();
+
+static bool verbose = false;
+
+static void hostLogprintf(const char *format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	std::vfprintf(stderr, format, arguments);
+	va_end(arguments);
+	std::fputc('\n', stderr);
+}
+
+static boost::uint64_t microseconds()
+{
+	boost::posix_time::time_duration elapsed = boost::posix_time::microsec_clock::universal_time() - boost::posix_time::ptime(boost::gregorian::date(1970, 1, 1));
+	return static_cast<boost::uint64_t>(elapsed.total_microseconds());
+}
+
+static unsigned long residentMemory()
+{
+	unsigned long size = 0, resident = 0;
+	FILE *file = std::fopen("/proc/self/statm", "r");
+	if (file)
+	{
+		if (std::fscanf(file, "%lu %lu", &size, &resident) != 2)
+		{
+			resident = 0;
+		}
+		std::fclose(file);
+	}
+	return resident * static_cast<unsigned long>(sysconf(_SC_PAGESIZE));
+}
+
+// Stub scripts
+
+static const char *callbackNames[] =
+{
+	"IRC_OnConnect",
+	"IRC_OnDisconnect",
+	"IRC_OnConnectAttempt",
+	"IRC_OnConnectAttemptFail",
+	"IRC_OnJoinChannel",
+	"IRC_OnLeaveChannel",
+	"IRC_OnInvitedToChannel",
+	"IRC_OnKickedFromChannel",
+	"IRC_OnUserDisconnect",
+	"IRC_OnNetSplit",
+	"IRC_OnNetJoin",
+	"IRC_OnUserJoinChannel",
+	"IRC_OnUserLeaveChannel",
+	"IRC_OnUserKickedFromChannel",
+	"IRC_OnUserNickChange",
+	"IRC_OnUserSetChannelMode",
+	"IRC_OnUserSetChannelTopic",
+	"IRC_OnUserSay",
+	"IRC_OnUserNotice",
+	"IRC_OnUserRequestCTCP",
+	"IRC_OnUserReplyCTCP",
+	"IRC_OnReceiveNumeric",
+	"IRC_OnReceiveRaw"
+};
+
+static const std::size_t numCallbacks = sizeof(callbackNames) / sizeof(const char*);
+
+struct Script
+{
+	Script() : memory(65536)
+	{
+		std::memset(&amx, 0, sizeof(amx));
+		amx.data = reinterpret_cast<unsigned char*>(&memory[0]);
+		amx.hea = 0;
+		amx.hlw = 0;
+		amx.stp = static_cast<cell>(memory.size() * sizeof(cell));
+		calls.resize(numCallbacks);
+	}
+
+	AMX amx;
+	std::vector<cell> memory;
+	std::vector<cell> arguments;
+	std::vector<std::size_t> calls;
+	std::map<std::string, AMX_NATIVE> natives;
+};
+
+static std::map<AMX*, Script*> scripts;
+
+static Script *findScript(AMX *amx)
+{
+	std::map<AMX*, Script*>::iterator s = scripts.find(amx);
+	return s != scripts.end() ? s->second : NULL;
+}
+
+// Emulated AMX exports
+
+static int AMXAPI amxUnsupported()
+{
+	return AMX_ERR_NOTFOUND;
+}
+
+static int AMXAPI amxAllot(AMX *amx, int cells, cell *amx_addr, cell **phys_addr)
+{
+	if (amx->hea + cells * static_cast<cell>(sizeof(cell)) >= amx->stp)
+	{
+		return AMX_ERR_MEMORY;
+	}
+	*amx_addr = amx->hea;
+	*phys_addr = reinterpret_cast<cell*>(amx->data + amx->hea);
+	amx->hea += cells * static_cast<cell>(sizeof(cell));
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxExec(AMX *amx, cell *retval, int index)
+{
+	Script *script = findScript(amx);
+	if (!script || index < 0 || static_cast<std::size_t>(index) >= numCallbacks)
+	{
+		return AMX_ERR_INDEX;
+	}
+	++script->calls[index];
+	if (verbose)
+	{
+		std::string line = callbackNames[index];
+		line += "(";
+		for (std::vector<cell>::reverse_iterator a = script->arguments.rbegin(); a != script->arguments.rend(); ++a)
+		{
+			if (a != script->arguments.rbegin())
+			{
+				line += ", ";
+			}
+			char buffer[32];
+			std::sprintf(buffer, "%d", static_cast<int>(*a));
+			line += buffer;
+		}
+		line += ")";
+		std::printf("%s\n", line.c_str());
+	}
+	script->arguments.clear();
+	if (retval)
+	{
+		*retval = 1;
+	}
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxFindPublic(AMX *amx, const char *funcname, int *index)
+{
+	for (std::size_t i = 0; i < numCallbacks; ++i)
+	{
+		if (!std::strcmp(callbackNames[i], funcname))
+		{
+			*index = static_cast<int>(i);
+			return AMX_ERR_NONE;
+		}
+	}
+	return AMX_ERR_NOTFOUND;
+}
+
+static int AMXAPI amxGetAddr(AMX *amx, cell amx_addr, cell **phys_addr)
+{
+	if (amx_addr < 0 || amx_addr >= amx->stp)
+	{
+		*phys_addr = NULL;
+		return AMX_ERR_MEMACCESS;
+	}
+	*phys_addr = reinterpret_cast<cell*>(amx->data + amx_addr);
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxGetString(char *dest, const cell *source, int use_wchar, size_t size)
+{
+	std::size_t i = 0;
+	while (i + 1 < size && source[i])
+	{
+		dest[i] = static_cast<char>(source[i]);
+		++i;
+	}
+	if (size)
+	{
+		dest[i] = '\0';
+	}
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxPush(AMX *amx, cell value)
+{
+	Script *script = findScript(amx);
+	if (script)
+	{
+		script->arguments.push_back(value);
+	}
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxSetString(cell *dest, const char *source, int pack, int use_wchar, size_t size)
+{
+	std::size_t i = 0;
+	while (i + 1 < size && source[i])
+	{
+		dest[i] = static_cast<cell>(static_cast<unsigned char>(source[i]));
+		++i;
+	}
+	if (size)
+	{
+		dest[i] = 0;
+	}
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxPushString(AMX *amx, cell *amx_addr, cell **phys_addr, const char *string, int pack, int use_wchar)
+{
+	cell *physicalAddress = NULL;
+	std::size_t length = std::strlen(string) + 1;
+	int error = amxAllot(amx, static_cast<int>(length), amx_addr, &physicalAddress);
+	if (error == AMX_ERR_NONE)
+	{
+		amxSetString(physicalAddress, string, pack, use_wchar, length);
+		if (phys_addr)
+		{
+			*phys_addr = physicalAddress;
+		}
+		amxPush(amx, *amx_addr);
+	}
+	return error;
+}
+
+static int AMXAPI amxRegister(AMX *amx, const AMX_NATIVE_INFO *nativelist, int number)
+{
+	Script *script = findScript(amx);
+	if (!script)
+	{
+		return AMX_ERR_NOTFOUND;
+	}
+	for (int i = 0; (number < 0 || i < number) && nativelist[i].name; ++i)
+	{
+		script->natives[nativelist[i].name] = nativelist[i].func;
+	}
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxRelease(AMX *amx, cell amx_addr)
+{
+	if (amx->hea > amx_addr)
+	{
+		amx->hea = amx_addr;
+	}
+	return AMX_ERR_NONE;
+}
+
+static int AMXAPI amxStrLen(const cell *cstring, int *length)
+{
+	int i = 0;
+	while (cstring[i])
+	{
+		++i;
+	}
+	*length = i;
+	return AMX_ERR_NONE;
+}
+
+// Native calls
+
+struct Argument
+{
+	Argument(int value) : isString(false), output(NULL), outputString(NULL), value(value), size(0) {}
+	Argument(const char *string) : isString(true), output(NULL), outputString(NULL), value(0), string(string), size(0) {}
+	Argument(const char *string, int size) : isString(true), output(NULL), outputString(NULL), value(0), string(string), size(size) {}
+	Argument(cell *output) : isString(false), output(output), outputString(NULL), value(0), size(0) {}
+	Argument(std::string *outputString, int size) : isString(true), output(NULL), outputString(outputString), value(0), size(size) {}
+
+	bool isString;
+	cell *output;
+	std::string *outputString;
+	int value;
+	std::string string;
+	int size;
+};
+
+static cell callNative(Script *script, const std::string &name, const std::vector<Argument> &arguments)
+{
+	std::map<std::string, AMX_NATIVE>::iterator n = script->natives.find(name);
+	if (n == script->natives.end())
+	{
+		hostLogprintf("*** Host: Native %s is not registered", name.c_str());
+		return 0;
+	}
+	std::vector<cell> params(arguments.size() + 1);
+	std::vector<cell*> physicalAddresses(arguments.size());
+	params[0] = static_cast<cell>(arguments.size() * sizeof(cell));
+	cell heap = script->amx.hea;
+	for (std::size_t i = 0; i < arguments.size(); ++i)
+	{
+		if (arguments[i].isString)
+		{
+			cell address = 0;
+			std::size_t size = std::max(arguments[i].string.length() + 1, static_cast<std::size_t>(arguments[i].size));
+			amxAllot(&script->amx, static_cast<int>(size), &address, &physicalAddresses[i]);
+			amxSetString(physicalAddresses[i], arguments[i].string.c_str(), 0, 0, size);
+			params[i + 1] = address;
+		}
+		else if (arguments[i].output)
+		{
+			cell address = 0;
+			amxAllot(&script->amx, 1, &address, &physicalAddresses[i]);
+			*physicalAddresses[i] = 0;
+			params[i + 1] = address;
+		}
+		else
+		{
+			params[i + 1] = static_cast<cell>(arguments[i].value);
+		}
+	}
+	cell result = n->second(&script->amx, &params[0]);
+	// Copy back anything the native wrote into reference or output string
+	// arguments before their heap space is released
+	for (std::size_t i = 0; i < arguments.size(); ++i)
+	{
+		if (arguments[i].output)
+		{
+			*arguments[i].output = *physicalAddresses[i];
+		}
+		else if (arguments[i].outputString)
+		{
+			std::vector<char> buffer(static_cast<std::size_t>(arguments[i].size) + 1);
+			amxGetString(&buffer[0], physicalAddresses[i], 0, buffer.size());
+			*arguments[i].outputString = &buffer[0];
+		}
+	}
+	amxRelease(&script->amx, heap);
+	return result;
+}
+
+// Loopback server
+
+struct Server
+{
+	Server() : listener(-1), port(0), interval(0) {}
+
+	int listener;
+	unsigned short port;
+	std::string fileName;
+	int interval;
+};
+
+static void serveCapture(Server server)
+{
+	int connection = accept(server.listener, NULL, NULL);
+	if (connection < 0)
+	{
+		return;
+	}
+	CaptureReader reader;
+	if (!reader.open(server.fileName))
+	{
+		hostLogprintf("*** Host: Error opening capture file \"%s\"", server.fileName.c_str());
+		close(connection);
+		return;
+	}
+	boost::uint64_t timestamp = 0;
+	std::string data;
+	while (reader.read(timestamp, data))
+	{
+		if (send(connection, data.data(), data.length(), MSG_NOSIGNAL) < 0)
+		{
+			break;
+		}
+		if (server.interval)
+		{
+			boost::this_thread::sleep(boost::posix_time::microseconds(server.interval));
+		}
+	}
+	char buffer[4096];
+	while (recv(connection, buffer, sizeof(buffer), 0) > 0)
+	{
+	}
+	close(connection);
+}
+
+static bool startServer(Server &server)
+{
+	server.listener = socket(AF_INET, SOCK_STREAM, 0);
+	if (server.listener < 0)
+	{
+		return false;
+	}
+	sockaddr_in address;
+	std::memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	address.sin_port = 0;
+	socklen_t length = sizeof(address);
+	if (bind(server.listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)) < 0 || listen(server.listener, 1) < 0 || getsockname(server.listener, reinterpret_cast<sockaddr*>(&address), &length) < 0)
+	{
+		close(server.listener);
+		return false;
+	}
+	server.port = ntohs(address.sin_port);
+	boost::thread thread(boost::bind(serveCapture, server));
+	return true;
+}
+
+static void printUsage(const char *program)
+{
+	std::fprintf(stderr, "Usage: %s [options]\n", program);
+	std::fprintf(stderr, "  -p plugin      Path to the plugin (default bin/linux/Release/irc.so)\n");
+	std::fprintf(stderr, "  -s scripts     Number of stub scripts to load (default 1)\n");
+	std::fprintf(stderr, "  -r rate        Server ticks per second (default 100)\n");
+	std::fprintf(stderr, "  -d seconds     How long to drive ticks (default 10)\n");
+	std::fprintf(stderr, "  -c host:port   Connect a bot to an IRC server\n");
+	std::fprintf(stderr, "  -f capture     Serve a capture file to a bot over a loopback socket\n");
+	std::fprintf(stderr, "  -w interval    Microseconds between captured reads when serving (default 0)\n");
+	std::fprintf(stderr, "  -n nickname    Nickname for the bot (default bot)\n");
+	std::fprintf(stderr, "  -j channel     Channel to join after connecting\n");
+	std::fprintf(stderr, "  -b iterations  Native latency iterations (default 100000)\n");
+	std::fprintf(stderr, "  -t trace       Write a trace file with IRC_WriteTrace before unloading\n");
+	std::fprintf(stderr, "  -P threshold   Profile callbacks, logging any slower than this many microseconds\n");
+	std::fprintf(stderr, "  -q high:low    Event queue watermarks for pausing and resuming socket reads\n");
+	std::fprintf(stderr, "  -S channel     Subscribe every script but the first to this channel only\n");
+	std::fprintf(stderr, "  -v             Print every callback\n");
+}
+
+int main(int argc, char **argv)
+{
+	std::string pluginPath = "bin/linux/Release/irc.so", remoteAddress, captureFile, nickname = "bot", channel, traceFile, subscribedChannel;
+	int numScripts = 1, rate = 100, duration = 10, remotePort = 6667, iterations = 100000, slowThreshold = -1, highWatermark = 0, lowWatermark = 0;
+	Server server;
+	for (int i = 1; i < argc; ++i)
+	{
+		std::string option = argv[i];
+		if (option == "-v")
+		{
+			verbose = true;
+			continue;
+		}
+		if (i + 1 >= argc)
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+		std::string value = argv[++i];
+		if (option == "-p")
+		{
+			pluginPath = value;
+		}
+		else if (option == "-s")
+		{
+			numScripts = std::atoi(value.c_str());
+		}
+		else if (option == "-r")
+		{
+			rate = std::atoi(value.c_str());
+		}
+		else if (option == "-d")
+		{
+			duration = std::atoi(value.c_str());
+		}
+		else if (option == "-c")
+		{
+			std::size_t colon = value.rfind(':');
+			remoteAddress = value.substr(0, colon);
+			if (colon != std::string::npos)
+			{
+				remotePort = std::atoi(value.substr(colon + 1).c_str());
+			}
+		}
+		else if (option == "-f")
+		{
+			captureFile = value;
+		}
+		else if (option == "-w")
+		{
+			server.interval = std::atoi(value.c_str());
+		}
+		else if (option == "-n")
+		{
+			nickname = value;
+		}
+		else if (option == "-j")
+		{
+			channel = value;
+		}
+		else if (option == "-t")
+		{
+			traceFile = value;
+		}
+		else if (option == "-b")
+		{
+			iterations = std::atoi(value.c_str());
+		}
+		else if (option == "-P")
+		{
+			slowThreshold = std::atoi(value.c_str());
+		}
+		else if (option == "-q")
+		{
+			std::size_t colon = value.find(':');
+			highWatermark = std::atoi(value.substr(0, colon).c_str());
+			if (colon != std::string::npos)
+			{
+				lowWatermark = std::atoi(value.substr(colon + 1).c_str());
+			}
+		}
+		else if (option == "-S")
+		{
+			subscribedChannel = value;
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (numScripts < 1 || rate < 1 || duration < 0)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+	void *plugin = dlopen(pluginPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+	if (!plugin)
+	{
+		std::fprintf(stderr, "Error loading plugin: %s\n", dlerror());
+		return 1;
+	}
+	Supports_t Supports = reinterpret_cast<Supports_t>(dlsym(plugin, "Supports"));
+	Load_t Load = reinterpret_cast<Load_t>(dlsym(plugin, "Load"));
+	Unload_t Unload = reinterpret_cast<Unload_t>(dlsym(plugin, "Unload"));
+	AmxLoad_t AmxLoad = reinterpret_cast<AmxLoad_t>(dlsym(plugin, "AmxLoad"));
+	AmxUnload_t AmxUnload = reinterpret_cast<AmxUnload_t>(dlsym(plugin, "AmxUnload"));
+	ProcessTick_t ProcessTick = reinterpret_cast<ProcessTick_t>(dlsym(plugin, "ProcessTick"));
+	if (!Supports || !Load || !Unload || !AmxLoad || !AmxUnload || !ProcessTick)
+	{
+		std::fprintf(stderr, "Error loading plugin: missing exports\n");
+		return 1;
+	}
+	void *amxFunctions[PLUGIN_AMX_EXPORT_UTF8Put + 1];
+	for (std::size_t i = 0; i < sizeof(amxFunctions) / sizeof(void*); ++i)
+	{
+		amxFunctions[i] = reinterpret_cast<void*>(amxUnsupported);
+	}
+	amxFunctions[PLUGIN_AMX_EXPORT_Allot] = reinterpret_cast<void*>(amxAllot);
+	amxFunctions[PLUGIN_AMX_EXPORT_Exec] = reinterpret_cast<void*>(amxExec);
+	amxFunctions[PLUGIN_AMX_EXPORT_FindPublic] = reinterpret_cast<void*>(amxFindPublic);
+	amxFunctions[PLUGIN_AMX_EXPORT_GetAddr] = reinterpret_cast<void*>(amxGetAddr);
+	amxFunctions[PLUGIN_AMX_EXPORT_GetString] = reinterpret_cast<void*>(amxGetString);
+	amxFunctions[PLUGIN_AMX_EXPORT_Push] = reinterpret_cast<void*>(amxPush);
+	amxFunctions[PLUGIN_AMX_EXPORT_PushString] = reinterpret_cast<void*>(amxPushString);
+	amxFunctions[PLUGIN_AMX_EXPORT_Register] = reinterpret_cast<void*>(amxRegister);
+	amxFunctions[PLUGIN_AMX_EXPORT_Release] = reinterpret_cast<void*>(amxRelease);
+	amxFunctions[PLUGIN_AMX_EXPORT_SetString] = reinterpret_cast<void*>(amxSetString);
+	amxFunctions[PLUGIN_AMX_EXPORT_StrLen] = reinterpret_cast<void*>(amxStrLen);
+	void *pluginData[256] = { 0 };
+	pluginData[PLUGIN_DATA_LOGPRINTF] = reinterpret_cast<void*>(hostLogprintf);
+	pluginData[PLUGIN_DATA_AMX_EXPORTS] = amxFunctions;
+	unsigned long baseMemory = residentMemory();
+	if (!(Supports() & SUPPORTS_AMX_NATIVES) || !Load(pluginData))
+	{
+		std::fprintf(stderr, "Error loading plugin: Load failed\n");
+		return 1;
+	}
+	std::vector<Script*> loadedScripts;
+	for (int i = 0; i < numScripts; ++i)
+	{
+		Script *script = new Script;
+		scripts.insert(std::make_pair(&script->amx, script));
+		loadedScripts.push_back(script);
+		AmxLoad(&script->amx);
+		if (i && !subscribedChannel.empty())
+		{
+			std::vector<Argument> arguments;
+			arguments.push_back(0);
+			arguments.push_back(subscribedChannel.c_str());
+			arguments.push_back(-1);
+			callNative(script, "IRC_Subscribe", arguments);
+		}
+	}
+	Script *primary = loadedScripts.front();
+	int botID = 0;
+	if (!captureFile.empty())
+	{
+		server.fileName = captureFile;
+		if (!startServer(server))
+		{
+			std::fprintf(stderr, "Error starting loopback server\n");
+			return 1;
+		}
+		remoteAddress = "127.0.0.1";
+		remotePort = server.port;
+	}
+	if (!remoteAddress.empty())
+	{
+		std::vector<Argument> arguments;
+		arguments.push_back(remoteAddress.c_str());
+		arguments.push_back(remotePort);
+		arguments.push_back(nickname.c_str());
+		arguments.push_back(nickname.c_str());
+		arguments.push_back(nickname.c_str());
+		arguments.push_back(0);
+		arguments.push_back("");
+		arguments.push_back("");
+		botID = callNative(primary, "IRC_Connect", arguments);
+		std::vector<Argument> settings;
+		settings.push_back(botID);
+		settings.push_back(1);
+		settings.push_back(0);
+		callNative(primary, "IRC_SetIntData", settings);
+	}
+	if (highWatermark > 0)
+	{
+		std::vector<Argument> arguments;
+		arguments.push_back(highWatermark);
+		arguments.push_back(lowWatermark);
+		callNative(primary, "IRC_SetQueueLimits", arguments);
+	}
+	if (slowThreshold >= 0)
+	{
+		std::vector<Argument> arguments;
+		arguments.push_back(1);
+		arguments.push_back(slowThreshold);
+		callNative(primary, "IRC_SetProfiling", arguments);
+	}
+	bool joined = channel.empty();
+	boost::uint64_t tickInterval = 1000000 / rate, tickTime = 0, maxTickTime = 0, ticks = 0;
+	cell maxQueued = 0;
+	boost::uint64_t start = microseconds(), next = start;
+	while (microseconds() - start < static_cast<boost::uint64_t>(duration) * 1000000)
+	{
+		boost::uint64_t tickStart = microseconds();
+		ProcessTick();
+		boost::uint64_t elapsed = microseconds() - tickStart;
+		tickTime += elapsed;
+		maxTickTime = std::max(maxTickTime, elapsed);
+		++ticks;
+		if (highWatermark > 0)
+		{
+			cell queued = 0, pausedBots = 0, pauses = 0;
+			std::vector<Argument> arguments;
+			arguments.push_back(&queued);
+			arguments.push_back(&pausedBots);
+			arguments.push_back(&pauses);
+			callNative(primary, "IRC_GetQueueStats", arguments);
+			maxQueued = std::max(maxQueued, queued);
+		}
+		if (!joined && primary->calls[0])
+		{
+			std::vector<Argument> arguments;
+			arguments.push_back(botID);
+			arguments.push_back(channel.c_str());
+			arguments.push_back("");
+			callNative(primary, "IRC_JoinChannel", arguments);
+			joined = true;
+		}
+		next += tickInterval;
+		boost::uint64_t now = microseconds();
+		if (next > now)
+		{
+			boost::this_thread::sleep(boost::posix_time::microseconds(next - now));
+		}
+	}
+	std::printf("Ticks: %lu at %d/s, ProcessTick average %.2f us, maximum %lu us\n", static_cast<unsigned long>(ticks), rate, ticks ? static_cast<double>(tickTime) / ticks : 0.0, static_cast<unsigned long>(maxTickTime));
+	std::size_t total = 0;
+	for (std::size_t i = 0; i < numCallbacks; ++i)
+	{
+		std::size_t calls = 0;
+		for (std::vector<Script*>::iterator s = loadedScripts.begin(); s != loadedScripts.end(); ++s)
+		{
+			calls += (*s)->calls[i];
+		}
+		if (calls)
+		{
+			std::printf("  %-28s %lu\n", callbackNames[i], static_cast<unsigned long>(calls));
+			total += calls;
+		}
+	}
+	if (ticks && total)
+	{
+		std::printf("Callbacks: %lu, average dispatch cost %.2f us per callback\n", static_cast<unsigned long>(total), static_cast<double>(tickTime) / total);
+	}
+	if (highWatermark > 0)
+	{
+		cell queued = 0, pausedBots = 0, pauses = 0;
+		std::vector<Argument> arguments;
+		arguments.push_back(&queued);
+		arguments.push_back(&pausedBots);
+		arguments.push_back(&pauses);
+		callNative(primary, "IRC_GetQueueStats", arguments);
+		std::printf("Event queue: %d queued (peak %d), %d bot(s) paused, reads paused %d time(s)\n", static_cast<int>(queued), static_cast<int>(maxQueued), static_cast<int>(pausedBots), static_cast<int>(pauses));
+	}
+	if (slowThreshold >= 0)
+	{
+		std::printf("Slowest callbacks by total time:\n");
+		for (int rank = 0; rank < 10; ++rank)
+		{
+			std::string callback;
+			cell script = 0, calls = 0, totalTime = 0, maxTime = 0;
+			std::vector<Argument> arguments;
+			arguments.push_back(rank);
+			arguments.push_back(Argument(&callback, 32));
+			arguments.push_back(&script);
+			arguments.push_back(&calls);
+			arguments.push_back(&totalTime);
+			arguments.push_back(&maxTime);
+			arguments.push_back(32);
+			if (!callNative(primary, "IRC_GetSlowCallback", arguments))
+			{
+				break;
+			}
+			std::printf("  %-28s script %d, %d calls, %d us total, %d us maximum\n", callback.c_str(), static_cast<int>(script), static_cast<int>(calls), static_cast<int>(totalTime), static_cast<int>(maxTime));
+		}
+	}
+	if (iterations > 0)
+	{
+		std::string benchmarkChannel = channel.empty() ? "#channel" : channel;
+		std::printf("Native latency (%d iterations):\n", iterations);
+		std::vector<std::pair<std::string, std::vector<Argument> > > benchmarks;
+		std::vector<Argument> arguments;
+		cell generation = 0;
+		arguments.push_back(botID);
+		arguments.push_back(benchmarkChannel.c_str());
+		arguments.push_back("user");
+		benchmarks.push_back(std::make_pair("IRC_IsUserOnChannel", arguments));
+		arguments.clear();
+		arguments.push_back(botID);
+		arguments.push_back(benchmarkChannel.c_str());
+		arguments.push_back(&generation);
+		benchmarks.push_back(std::make_pair("IRC_GetChannelUserCount", arguments));
+		arguments.clear();
+		arguments.push_back(botID);
+		arguments.push_back(benchmarkChannel.c_str());
+		arguments.push_back(0);
+		arguments.push_back(Argument("", 32));
+		arguments.push_back(32);
+		benchmarks.push_back(std::make_pair("IRC_GetChannelUser", arguments));
+		arguments.clear();
+		arguments.push_back(botID);
+		arguments.push_back(benchmarkChannel.c_str());
+		arguments.push_back(Argument("", 2048));
+		arguments.push_back(2048);
+		benchmarks.push_back(std::make_pair("IRC_GetChannelUserList", arguments));
+		arguments.clear();
+		arguments.push_back(botID);
+		arguments.push_back(benchmarkChannel.c_str());
+		arguments.push_back("user");
+		arguments.push_back(Argument("", 2));
+		benchmarks.push_back(std::make_pair("IRC_GetUserChannelMode", arguments));
+		arguments.clear();
+		arguments.push_back(botID);
+		arguments.push_back(benchmarkChannel.c_str());
+		arguments.push_back("[12] Player_Name: has anyone seen the admin around? need help with the race at LV airport");
+		benchmarks.push_back(std::make_pair("IRC_Say", arguments));
+		for (std::size_t b = 0; b < benchmarks.size(); ++b)
+		{
+			boost::uint64_t start = microseconds();
+			for (int i = 0; i < iterations; ++i)
+			{
+				callNative(primary, benchmarks[b].first, benchmarks[b].second);
+			}
+			boost::uint64_t elapsed = microseconds() - start;
+			std::printf("  %-24s %10.1f ns/call\n", benchmarks[b].first.c_str(), elapsed * 1000.0 / iterations);
+		}
+	}
+	std::printf("Resident memory: %lu KB at load, %lu KB now\n", baseMemory / 1024, residentMemory() / 1024);
+	if (!traceFile.empty())
+	{
+		std::vector<Argument> arguments;
+		arguments.push_back(traceFile.c_str());
+		if (callNative(primary, "IRC_WriteTrace", arguments))
+		{
+			std::printf("Trace written to %s\n", traceFile.c_str());
+		}
+	}
+	for (std::vector<Script*>::iterator s = loadedScripts.begin(); s != loadedScripts.end(); ++s)
+	{
+		AmxUnload(&(*s)->amx);
+	}
+	Unload();
+	return 0;
+}
@@ -0,0 +1,196 @@
+/*
+ * Copyright (C) 2016 Incognito
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// Offline replay driver for capture files written by IRC_StartCapture. Each
+// recorded read is fed through the client's framer and parser exactly as it
+// was received from the socket, so parser and membership changes can be
+// benchmarked against real traffic without a server.
+
+#include "../../src/capture.h"
+#include "../../src/client.h"
+#include "../../src/core.h"
+#include "../../src/main.h"
+#include "../../src/network.h"
+
+#include <boost/cstdint.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/scoped_ptr.hpp>
+#include <boost/thread.hpp>
+
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <string>
+
+logprintf_t logprintf;
+
+static const char *callbackNames[] =
+{
+	"OnConnect",
+	"OnDisconnect",
+	"OnConnectAttempt",
+	"OnConnectAttemptFail",
+	"OnJoinChannel",
+	"OnLeaveChannel",
+	"OnInvitedToChannel",
+	"OnKickedFromChannel",
+	"OnUserDisconnect",
+	"OnNetSplit",
+	"OnNetJoin",
+	"OnUserJoinChannel",
+	"OnUserLeaveChannel",
+	"OnUserKickedFromChannel",
+	"OnUserNickChange",
+	"OnUserSetChannelMode",
+	"OnUserSetChannelTopic",
+	"OnUserSay",
+	"OnUserNotice",
+	"OnUserRequestCTCP",
+	"OnUserReplyCTCP",
+	"OnReceiveNumeric",
+	"OnReceiveRaw"
+};
+
+static void replayLogprintf(const char *format, ...)
+{
+	va_list arguments;
+	va_start(arguments, format);
+	std::vfprintf(stderr, format, arguments);
+	va_end(arguments);
+	std::fputc('\n', stderr);
+}
+
+static void printUsage(const char *program)
+{
+	std::fprintf(stderr, "Usage: %s [-n nickname] [-r] [-i iterations] capture-file\n", program);
+	std::fprintf(stderr, "  -n nickname    Nickname the bot had when the capture was recorded\n");
+	std::fprintf(stderr, "  -r             Replay in real time using the recorded timestamps\n");
+	std::fprintf(stderr, "  -i iterations  Replay the capture this many times (default 1)\n");
+}
+
+int main(int argc, char **argv)
+{
+	const char *fileName = NULL;
+	std::string nickname = "bot";
+	bool realTime = false;
+	int iterations = 1;
+	for (int i = 1; i < argc; ++i)
+	{
+		if (!std::strcmp(argv[i], "-n") && i + 1 < argc)
+		{
+			nickname = argv[++i];
+		}
+		else if (!std::strcmp(argv[i], "-r"))
+		{
+			realTime = true;
+		}
+		else if (!std::strcmp(argv[i], "-i") && i + 1 < argc)
+		{
+			iterations = std::atoi(argv[++i]);
+		}
+		else if (argv[i][0] != '-' && fileName == NULL)
+		{
+			fileName = argv[i];
+		}
+		else
+		{
+			printUsage(argv[0]);
+			return 1;
+		}
+	}
+	if (fileName == NULL || iterations < 1)
+	{
+		printUsage(argv[0]);
+		return 1;
+	}
+	logprintf = replayLogprintf;
+	core.reset(new Core);
+	std::size_t chunks = 0, bytes = 0;
+	std::map<int, std::size_t> events;
+	boost::posix_time::time_duration elapsed;
+	SharedClient client;
+	for (int iteration = 0; iteration < iterations; ++iteration)
+	{
+		CaptureReader reader;
+		if (!reader.open(fileName))
+		{
+			std::fprintf(stderr, "Error opening capture file \"%s\"\n", fileName);
+			return 1;
+		}
+		client.reset(new Client(core->io_service));
+		client->botID = 1;
+		client->groupID = 0;
+		client->nickname = nickname;
+		client->ssl = false;
+		boost::uint64_t firstTimestamp = 0, timestamp = 0;
+		boost::posix_time::ptime replayStart = boost::posix_time::microsec_clock::universal_time();
+		std::string data;
+		while (reader.read(timestamp, data))
+		{
+			if (realTime)
+			{
+				if (!firstTimestamp)
+				{
+					firstTimestamp = timestamp;
+				}
+				boost::posix_time::ptime due = replayStart + boost::posix_time::microseconds(static_cast<boost::int64_t>(timestamp - firstTimestamp));
+				boost::this_thread::sleep(due);
+			}
+			boost::posix_time::ptime start = boost::posix_time::microsec_clock::universal_time();
+			boost::mutex::scoped_lock lock(core->mutex);
+			client->processData(data.data(), data.length());
+			elapsed += boost::posix_time::microsec_clock::universal_time() - start;
+			Data::Message message;
+			while (core->popMessage(message))
+			{
+				++events[message.array.at(0)];
+			}
+			lock.unlock();
+			++chunks;
+			bytes += data.length();
+		}
+	}
+	boost::mutex::scoped_lock lock(core->mutex);
+	std::size_t memberships = 0;
+	for (ChannelMap::iterator c = client->network->channels.begin(); c != client->network->channels.end(); ++c)
+	{
+		memberships += c->second.users.size();
+	}
+	double seconds = elapsed.total_microseconds() / 1000000.0;
+	std::printf("Replayed %lu chunk(s), %lu byte(s) in %.6f second(s)", static_cast<unsigned long>(chunks), static_cast<unsigned long>(bytes), seconds);
+	if (seconds > 0.0)
+	{
+		std::printf(" (%.2f MB/s, %.0f lines/s)", bytes / seconds / 1048576.0, events[Data::OnReceiveRaw] / seconds);
+	}
+	std::printf("\n");
+	for (std::map<int, std::size_t>::iterator e = events.begin(); e != events.end(); ++e)
+	{
+		if (e->first >= 0 && static_cast<std::size_t>(e->first) < sizeof(callbackNames) / sizeof(const char*))
+		{
+			std::printf("  IRC_%s: %lu\n", callbackNames[e->first], static_cast<unsigned long>(e->second));
+		}
+		else
+		{
+			std::printf("  Event %d: %lu\n", e->first, static_cast<unsigned long>(e->second));
+		}
+	}
+	std::printf("Final state: %lu user(s), %lu channel(s), %lu membership(s)\n", static_cast<unsigned long>(client->network->users.size()), static_cast<unsigned long>(client->network->channels.size()), static_cast<unsigned long>(memberships));
+	lock.unlock();
+	core->io_service.stop();
+	return 0;
+}